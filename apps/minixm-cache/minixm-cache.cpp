@@ -0,0 +1,203 @@
+//===============================================================================================
+// minixm-cache
+// Pan/SpinningKids, 2022-2025.
+//
+// Runs the shared memory module cache daemon, or plays modules through it: each client maps
+// the daemon's copy of a module instead of loading its own. Playing renders a few seconds of
+// each module and prints a checksum of the audio, which must match loading the file directly;
+// run several clients at once to see them share a single copy.
+//
+//===============================================================================================
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <minixm/module.h>
+#include <minixm/player_state.h>
+#include <minixm/system_file.h>
+#include <module_cache/module_cache.h>
+
+namespace
+{
+    const minifmod::FileAccess& file_access = minifmod::stdio_file_access;
+
+    // Pull driver: blocks are mixed only when asked for.
+    class ChecksumPlayback final : public IPlaybackDriver
+    {
+        FillFunction* fill_ = nullptr;
+        void* fill_arg_ = nullptr;
+        size_t current_block_ = 0;
+        uint64_t frames_rendered_ = 0;
+
+    public:
+        ChecksumPlayback(unsigned int mix_rate, unsigned int latency) :
+            IPlaybackDriver(mix_rate, latency, latency)
+        {
+        }
+
+        void start(FillFunction* fill, void* arg) override
+        {
+            fill_ = fill;
+            fill_arg_ = arg;
+            frames_rendered_ = 0;
+        }
+
+        void stop() override
+        {
+            fill_ = nullptr;
+        }
+
+        void render(short data[]) noexcept
+        {
+            current_block_ = (current_block_ + 1) % blocks();
+            fill_(fill_arg_, current_block_, data, block_size());
+            frames_rendered_ += block_size();
+        }
+
+        [[nodiscard]] uint64_t frames_played() const override
+        {
+            return frames_rendered_;
+        }
+    };
+
+    constexpr unsigned int mix_rate = 48000;
+
+    // FNV-1a of the first seconds of the module, as 16 bit stereo
+    uint64_t checksum(std::unique_ptr<Module> module, unsigned int seconds)
+    {
+        auto driver = std::make_unique<ChecksumPlayback>(mix_rate, 10);
+        ChecksumPlayback& playback = *driver;
+        std::vector<short> block(playback.block_size() * 2);
+        PlayerState player{std::move(driver), std::move(module)};
+
+        uint64_t hash = 0xcbf29ce484222325ull;
+        player.start();
+        for (uint64_t frames = 0; frames < static_cast<uint64_t>(seconds) * mix_rate; frames += playback.block_size())
+        {
+            playback.render(block.data());
+            for (const short value : block)
+            {
+                hash = (hash ^ static_cast<uint16_t>(value)) * 0x100000001b3ull;
+            }
+        }
+        player.stop();
+        return hash;
+    }
+
+    ModuleCacheServer* server = nullptr;
+
+    void stopServer(int)
+    {
+        server->stop();
+    }
+
+    int serve(const char* socket_path)
+    {
+        ModuleCacheServer cache{socket_path, file_access};
+        if (!cache.listening())
+        {
+            printf("cannot listen on %s\n", socket_path);
+            return 1;
+        }
+        server = &cache;
+        signal(SIGINT, stopServer);
+        signal(SIGTERM, stopServer);
+        printf("serving modules on %s\n", socket_path);
+        cache.run();
+        printf("%zu modules served\n", cache.modules());
+        return 0;
+    }
+
+    void printUsage()
+    {
+        printf("-------------------------------------------------------------\n");
+        printf("MINIXM shared memory module cache.\n");
+        printf("Pan/SpinningKids, 2022-2025.\n");
+        printf("-------------------------------------------------------------\n");
+        printf("Syntax: minixm-cache -d socket\n");
+        printf("        minixm-cache [options] file.xm ...\n\n");
+        printf("  -d <socket>   run the daemon, until interrupted\n");
+        printf("  -c <socket>   play modules mapped from the daemon (default: load the files)\n");
+        printf("  -i linear|mip sample interpolation (default linear)\n");
+        printf("  -s pcm|adpcm  sample storage (default pcm)\n");
+        printf("  -t <seconds>  length played from each module (default 30)\n\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* socket_path = nullptr;
+    unsigned int seconds = 30;
+    ModuleLoadOptions options;
+    std::vector<const char*> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc)
+        {
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'd':
+                return serve(value);
+            case 'c':
+                socket_path = value;
+                break;
+            case 'i':
+                options.mip_maps = !strcmp(value, "mip");
+                break;
+            case 's':
+                options.adpcm = !strcmp(value, "adpcm");
+                break;
+            case 't':
+                seconds = static_cast<unsigned int>(atoi(value));
+                break;
+            default:
+                printUsage();
+                return 1;
+            }
+            continue;
+        }
+        inputs.push_back(arg);
+    }
+
+    if (inputs.empty())
+    {
+        printUsage();
+        return 0;
+    }
+
+    const ModuleCacheClient client{socket_path ? socket_path : ""};
+    int failed = 0;
+    for (const char* input : inputs)
+    {
+        const auto load_start = std::chrono::steady_clock::now();
+        std::unique_ptr<Module> module;
+        if (socket_path)
+        {
+            module = client.load(input, options);
+        }
+        else if (void* fp = file_access.open(input))
+        {
+            module = std::make_unique<Module>(file_access, fp, nullptr, options);
+            file_access.close(fp);
+        }
+        const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                          load_start).count();
+        if (!module)
+        {
+            printf("%s: error loading song\n", input);
+            ++failed;
+            continue;
+        }
+        printf("%s: %s in %.2f ms, checksum %016llx\n", input, socket_path ? "mapped" : "loaded", load_ms,
+               static_cast<unsigned long long>(checksum(std::move(module), seconds)));
+    }
+    return failed ? 1 : 0;
+}
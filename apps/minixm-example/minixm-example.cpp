@@ -10,6 +10,8 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
 #ifdef WIN32
 #include <conio.h>
 #endif
@@ -17,10 +19,6 @@
 //#define USEMEMLOAD
 //#define USEMEMLOADRESOURCE
 
-#ifdef USEMEMLOAD
-#include <cstring>
-#endif
-
 #ifdef USEMEMLOADRESOURCE
 #define NOMINMAX
 #include <Windows.h>
@@ -30,11 +28,16 @@
 #include <minixm/module.h>
 #include <minixm/player_state.h>
 
+#include <file_playback/file_playback.h>
+#include <null_playback/null_playback.h>
 #ifdef WIN32
 #include <winmm_playback/winmm_playback.h>
 #else
 #include <pulseaudio_playback/pulseaudio_playback.h>
 #endif
+#ifdef HAVE_ALSA_PLAYBACK
+#include <alsa_playback/alsa_playback.h>
+#endif
 
 // this is if you want to replace the samples with your own (in case you have compressed them)
 void sample_load_callback(void* buff, int lenbytes, int numbits, int instno, int sampno)
@@ -44,27 +47,27 @@ void sample_load_callback(void* buff, int lenbytes, int numbits, int instno, int
 
 #ifndef USEMEMLOAD
 
-void* fileopen(const char* name)
+void* fileopen(void*, const char* name)
 {
     return fopen(name, "rb");
 }
 
-void fileclose(void* handle)
+void fileclose(void*, void* handle)
 {
     fclose((FILE*)handle);
 }
 
-size_t fileread(void* buffer, size_t count, void* handle)
+size_t fileread(void*, void* buffer, size_t count, void* handle)
 {
     return fread(buffer, 1, count, (FILE*)handle);
 }
 
-void fileseek(void* handle, long pos, int mode)
+void fileseek(void*, void* handle, long pos, int mode)
 {
     fseek((FILE*)handle, pos, mode);
 }
 
-long filetell(void* handle)
+long filetell(void*, void* handle)
 {
     return ftell((FILE*)handle);
 }
@@ -78,7 +81,7 @@ struct MEMFILE
     char* data;
 };
 
-void* memopen(const char* name)
+void* memopen(void*, const char* name)
 {
     const auto memfile = static_cast<MEMFILE*>(calloc(sizeof(MEMFILE), 1));
 
@@ -112,7 +115,7 @@ void* memopen(const char* name)
     return memfile;
 }
 
-void memclose(void* handle)
+void memclose(void*, void* handle)
 {
     const auto memfile = static_cast<MEMFILE*>(handle);
 
@@ -123,7 +126,7 @@ void memclose(void* handle)
     free(memfile);
 }
 
-size_t memread(void* buffer, size_t size, void* handle)
+size_t memread(void*, void* buffer, size_t size, void* handle)
 {
     const auto memfile = static_cast<MEMFILE*>(handle);
 
@@ -136,7 +139,7 @@ size_t memread(void* buffer, size_t size, void* handle)
     return size;
 }
 
-void memseek(void* handle, long pos, int mode)
+void memseek(void*, void* handle, long pos, int mode)
 {
     const auto memfile = static_cast<MEMFILE*>(handle);
 
@@ -151,7 +154,7 @@ void memseek(void* handle, long pos, int mode)
         memfile->pos = memfile->length;
 }
 
-long memtell(void* handle)
+long memtell(void*, void* handle)
 {
     const MEMFILE* memfile = static_cast<MEMFILE*>(handle);
 
@@ -159,6 +162,29 @@ long memtell(void* handle)
 }
 #endif
 
+// what the mixer did, from PlayerState::getStats()
+void printStats(const PlayerState& player_state)
+{
+    const MixerStats stats = player_state.getStats();
+    const GovernorStatus governor = player_state.getGovernorStatus();
+    printf("cpu %.2f%% of real time (%.2f%% in ticks), %llu blocks, %u voices (%u virtual, peak %u), "
+           "%llu loop wraps, %llu underruns, governor level %d\n",
+           stats.cpuUsage() * 100.0,
+           stats.audio_ns ? static_cast<double>(stats.tick_ns) * 100.0 / static_cast<double>(stats.audio_ns) : 0.0,
+           static_cast<unsigned long long>(stats.blocks), stats.active_voices, stats.virtual_voices,
+           stats.peak_voices, static_cast<unsigned long long>(stats.loop_wraps),
+           static_cast<unsigned long long>(stats.underruns), governor.level);
+    printf("fill time (us):");
+    for (int bucket = 0; bucket < MixerStats::fill_buckets; ++bucket)
+    {
+        if (stats.fill_histogram[bucket])
+        {
+            printf(" <%d:%llu", 1 << bucket, static_cast<unsigned long long>(stats.fill_histogram[bucket]));
+        }
+    }
+    printf("\n");
+}
+
 /*
 void songcallback(PlayerState *mod, unsigned char param)
 {
@@ -183,26 +209,62 @@ int main(int argc, char* argv[])
 {
     constexpr unsigned int mix_rate = 96000;
 #ifndef USEMEMLOAD
-    minifmod::file_access.open = fileopen;
-    minifmod::file_access.close = fileclose;
-    minifmod::file_access.read = fileread;
-    minifmod::file_access.seek = fileseek;
-    minifmod::file_access.tell = filetell;
+    const minifmod::FileAccess file_access{fileopen, fileclose, fileread, fileseek, filetell};
 #else
-    minifmod::file_access.open = memopen;
-    minifmod::file_access.close = memclose;
-    minifmod::file_access.read = memread;
-    minifmod::file_access.seek = memseek;
-    minifmod::file_access.tell = memtell;
+    const minifmod::FileAccess file_access{memopen, memclose, memread, memseek, memtell};
 #endif
 
-    if (argc < 2)
+    const char* wav_name = nullptr;
+    const char* null_mode = nullptr;
+#ifdef HAVE_ALSA_PLAYBACK
+    const char* alsa_device = nullptr;
+#endif
+    unsigned int seconds = 60;
+    unsigned int internal_rate = 0;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (!strcmp(argv[arg], "-w"))
+        {
+            wav_name = argv[arg + 1];
+        }
+        else if (!strcmp(argv[arg], "-n"))
+        {
+            null_mode = argv[arg + 1];
+        }
+#ifdef HAVE_ALSA_PLAYBACK
+        else if (!strcmp(argv[arg], "-a"))
+        {
+            alsa_device = argv[arg + 1];
+        }
+#else
+        else if (!strcmp(argv[arg], "-a"))
+        {
+            printf("ALSA support not built\n");
+            return 0;
+        }
+#endif
+        else if (!strcmp(argv[arg], "-t"))
+        {
+            seconds = static_cast<unsigned int>(atoi(argv[arg + 1]));
+        }
+        else if (!strcmp(argv[arg], "-m"))
+        {
+            internal_rate = static_cast<unsigned int>(atoi(argv[arg + 1]));
+        }
+    }
+
+    if (arg >= argc)
     {
         printf("-------------------------------------------------------------\n");
         printf("MINIFMOD example XM player.\n");
         printf("Pan/SpinningKids, 2022-2024.\n");
         printf("-------------------------------------------------------------\n");
-        printf("Syntax: simplest infile.xm\n\n");
+#ifdef HAVE_ALSA_PLAYBACK
+        printf("Syntax: simplest [-w outfile.wav | -n free|paced | -a alsadevice] [-t seconds] [-m mixrate] infile.xm\n\n");
+#else
+        printf("Syntax: simplest [-w outfile.wav | -n free|paced] [-t seconds] [-m mixrate] infile.xm\n\n");
+#endif
         return 0;
     }
 
@@ -210,11 +272,11 @@ int main(int argc, char* argv[])
     // LOAD SONG
     // ==========================================================================================
     std::unique_ptr<Module> mod;
-    if (void* fp = minifmod::file_access.open(argv[1]))
+    if (void* fp = file_access.open(argv[arg]))
     {
         // create a mod instance
-        mod = std::make_unique<Module>(minifmod::file_access, fp, nullptr);
-        minifmod::file_access.close(fp);
+        mod = std::make_unique<Module>(file_access, fp, nullptr);
+        file_access.close(fp);
     }
 
     if (!mod)
@@ -227,15 +289,77 @@ int main(int argc, char* argv[])
     // PLAY SONG
     // ==========================================================================================
     std::unique_ptr<IPlaybackDriver> playback;
+    FileWriterPlayback* file_playback = nullptr;
+    NullPlayback* null_playback = nullptr;
+    if (wav_name)
+    {
+        auto file_writer = std::make_unique<FileWriterPlayback>(wav_name, mix_rate, FileWriterPlayback::Format::Wav,
+                                                                static_cast<uint64_t>(seconds) * mix_rate);
+        if (file_writer->failed())
+        {
+            printf("Error creating %s\n", wav_name);
+            return 0;
+        }
+        file_playback = file_writer.get();
+        playback = std::move(file_writer);
+    }
+    else if (null_mode)
+    {
+        auto null_driver = std::make_unique<NullPlayback>(mix_rate, strcmp(null_mode, "paced")
+                                                                        ? NullPlayback::Mode::FreeRunning
+                                                                        : NullPlayback::Mode::Paced);
+        null_playback = null_driver.get();
+        playback = std::move(null_driver);
+    }
+#ifdef HAVE_ALSA_PLAYBACK
+    else if (alsa_device)
+    {
+        playback = std::make_unique<AlsaPlayback>(mix_rate, alsa_device);
+    }
+#endif
+    else
+    {
 #ifdef WIN32
-    playback = std::make_unique<WindowsPlayback>(mix_rate);
+        playback = std::make_unique<WindowsPlayback>(mix_rate);
 #else
-    playback = std::make_unique<PulseAudioPlayback>(mix_rate);
+        playback = std::make_unique<PulseAudioPlayback>(mix_rate);
 #endif
-    PlayerState player_state{std::move(playback), std::move(mod)};
+    }
+    PlayerState player_state{std::move(playback), std::move(mod), internal_rate};
 
     player_state.start();
 
+    if (file_playback)
+    {
+        printf("Writing %s...\n", wav_name);
+        while (!file_playback->finished())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        mod = player_state.stop();
+        return 0;
+    }
+
+    if (null_playback)
+    {
+        // run for the given wall-clock time, then report how fast the mixer went
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            const auto [position, samples] = player_state.getTimeInfo();
+            printf("ord %2d row %2d seconds %5.02f %8.1fx realtime      \r", position.order, position.row,
+                   static_cast<double>(samples) / mix_rate, null_playback->frames_per_second() / mix_rate);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        printf("\n%llu frames mixed, %.0f frames/s (%.1fx realtime), %llu underruns\n",
+               static_cast<unsigned long long>(null_playback->frames_mixed()), null_playback->frames_per_second(),
+               null_playback->frames_per_second() / mix_rate,
+               static_cast<unsigned long long>(null_playback->underruns()));
+        printStats(player_state);
+        mod = player_state.stop();
+        return 0;
+    }
+
     printf("Press any key to quit\n");
     printf("=========================================================================\n");
     printf("Playing song...\n");
@@ -259,6 +383,7 @@ int main(int argc, char* argv[])
     }
 
     printf("\n");
+    printStats(player_state);
 
     mod = player_state.stop();
 }
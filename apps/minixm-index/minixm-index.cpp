@@ -0,0 +1,337 @@
+//===============================================================================================
+// minixm-index
+// Pan/SpinningKids, 2022-2025.
+//
+// Indexes directory trees of XM files into a compact index file, scanning headers only (no
+// pattern or sample data is read) on all the available cores, and lists index files.
+//
+//===============================================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <minixm/module_info.h>
+#include <minixm/system_file.h>
+
+namespace
+{
+    const minifmod::FileAccess& file_access = minifmod::stdio_file_access;
+
+    // Index file: "MXIX", a version and the entry count, then for each module its path, name, tracker and
+    // instrument names as length-prefixed strings, and its numbers at their XM widths. All little endian.
+    constexpr char index_magic[4] = {'M', 'X', 'I', 'X'};
+    constexpr uint32_t index_version = 1;
+
+    struct Entry
+    {
+        std::string path;
+        ModuleInfo info;
+        bool valid = false;
+    };
+
+    class IndexWriter
+    {
+        FILE* fp_;
+        bool ok_ = true;
+
+    public:
+        explicit IndexWriter(FILE* fp) : fp_{fp} {}
+
+        // false once any write has failed
+        [[nodiscard]] bool ok() const { return ok_; }
+
+        void put(const void* data, size_t size)
+        {
+            ok_ = ok_ && fwrite(data, 1, size, fp_) == size;
+        }
+
+        template <typename T>
+        void put(T value)
+        {
+            static_assert(std::is_unsigned_v<T>);
+            uint8_t bytes[sizeof(T)];
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+            put(bytes, sizeof(bytes));
+        }
+
+        void put(const std::string& text)
+        {
+            const auto length = static_cast<uint16_t>(std::min<size_t>(text.size(), UINT16_MAX));
+            put(length);
+            put(text.data(), length);
+        }
+
+        void put(const Entry& entry)
+        {
+            const ModuleInfo& info = entry.info;
+            put(entry.path);
+            put(info.name);
+            put(info.tracker);
+            put(static_cast<uint16_t>(info.channels));
+            put(static_cast<uint16_t>(info.song_length));
+            put(static_cast<uint16_t>(info.patterns));
+            put(static_cast<uint16_t>(info.tempo));
+            put(static_cast<uint16_t>(info.bpm));
+            put(static_cast<uint8_t>(info.linear_frequencies));
+            put(info.rows);
+            put(info.samples);
+            put(info.sample_bytes);
+            put(static_cast<uint16_t>(info.instrument_names.size()));
+            for (const std::string& name : info.instrument_names)
+            {
+                put(name);
+            }
+        }
+    };
+
+    class IndexReader
+    {
+        FILE* fp_;
+        bool ok_ = true;
+
+    public:
+        explicit IndexReader(FILE* fp) : fp_{fp} {}
+
+        [[nodiscard]] bool ok() const { return ok_; }
+
+        template <typename T>
+        T get()
+        {
+            static_assert(std::is_unsigned_v<T>);
+            uint8_t bytes[sizeof(T)]{};
+            ok_ = ok_ && fread(bytes, 1, sizeof(bytes), fp_) == sizeof(bytes);
+            T value = 0;
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                value |= static_cast<T>(static_cast<T>(bytes[i]) << (8 * i));
+            }
+            return value;
+        }
+
+        std::string getString()
+        {
+            std::string text(get<uint16_t>(), '\0');
+            ok_ = ok_ && fread(text.data(), 1, text.size(), fp_) == text.size();
+            return text;
+        }
+
+        Entry getEntry()
+        {
+            Entry entry;
+            ModuleInfo& info = entry.info;
+            entry.path = getString();
+            info.name = getString();
+            info.tracker = getString();
+            info.channels = get<uint16_t>();
+            info.song_length = get<uint16_t>();
+            info.patterns = get<uint16_t>();
+            info.tempo = get<uint16_t>();
+            info.bpm = get<uint16_t>();
+            info.linear_frequencies = get<uint8_t>();
+            info.rows = get<uint32_t>();
+            info.samples = get<uint32_t>();
+            info.sample_bytes = get<uint64_t>();
+            info.instruments = get<uint16_t>();
+            for (int i = 0; i < info.instruments; ++i)
+            {
+                info.instrument_names.push_back(getString());
+            }
+            entry.valid = ok_;
+            return entry;
+        }
+    };
+
+    bool isModule(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().string();
+        for (auto& c : extension)
+        {
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+        return extension == ".xm";
+    }
+
+    int list(const char* name, bool instruments)
+    {
+        FILE* fp = fopen(name, "rb");
+        if (!fp)
+        {
+            printf("cannot open %s\n", name);
+            return 1;
+        }
+        IndexReader reader{fp};
+        char magic[4];
+        const bool header_ok = fread(magic, 1, 4, fp) == 4 && !memcmp(magic, index_magic, 4) &&
+            reader.get<uint32_t>() == index_version;
+        const uint32_t count = header_ok ? reader.get<uint32_t>() : 0;
+        if (!header_ok || !reader.ok())
+        {
+            printf("%s is not a minixm index\n", name);
+            fclose(fp);
+            return 1;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const Entry entry = reader.getEntry();
+            if (!entry.valid)
+            {
+                printf("%s is truncated\n", name);
+                fclose(fp);
+                return 1;
+            }
+            const ModuleInfo& info = entry.info;
+            printf("%s\t%s\t%dch\t%d orders\t%d patterns\t%d instruments\t%d/%d\t%u samples\t%llu bytes\n",
+                   entry.path.c_str(), info.name.c_str(), info.channels, info.song_length, info.patterns,
+                   info.instruments, info.tempo, info.bpm, info.samples,
+                   static_cast<unsigned long long>(info.sample_bytes));
+            if (instruments)
+            {
+                for (const std::string& instrument : info.instrument_names)
+                {
+                    printf("\t%s\n", instrument.c_str());
+                }
+            }
+        }
+        fclose(fp);
+        return 0;
+    }
+
+    void printUsage()
+    {
+        printf("-------------------------------------------------------------\n");
+        printf("MINIXM library indexer.\n");
+        printf("Pan/SpinningKids, 2022-2025.\n");
+        printf("-------------------------------------------------------------\n");
+        printf("Syntax: minixm-index [options] -o index.mxi file.xm|directory ...\n");
+        printf("        minixm-index -l|-L index.mxi\n\n");
+        printf("  -o <file>     index file to write\n");
+        printf("  -j <threads>  number of worker threads (default: all cores)\n");
+        printf("  -l <file>     list an index, -L with instrument names\n\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* output = nullptr;
+    unsigned int requested_threads = 0;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc)
+        {
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'o':
+                output = value;
+                break;
+            case 'j':
+                requested_threads = static_cast<unsigned int>(atoi(value));
+                break;
+            case 'l':
+            case 'L':
+                return list(value, arg[1] == 'L');
+            default:
+                printUsage();
+                return 1;
+            }
+            continue;
+        }
+
+        std::error_code ec;
+        if (std::filesystem::is_directory(arg, ec))
+        {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(arg, ec))
+            {
+                if (entry.is_regular_file() && isModule(entry.path()))
+                {
+                    inputs.push_back(entry.path());
+                }
+            }
+        }
+        else
+        {
+            inputs.emplace_back(arg);
+        }
+    }
+
+    if (inputs.empty() || !output)
+    {
+        printUsage();
+        return inputs.empty() && !output ? 0 : 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Entry> entries(inputs.size());
+    {
+        const unsigned int threads = std::max(1u, std::min(requested_threads ? requested_threads
+                                                                             : std::thread::hardware_concurrency(),
+                                                            static_cast<unsigned int>(inputs.size())));
+        std::atomic<size_t> next{0};
+        std::vector<std::jthread> workers;
+        for (unsigned int worker_index = 0; worker_index < threads; ++worker_index)
+        {
+            workers.emplace_back([&]
+            {
+                for (size_t job = next++; job < inputs.size(); job = next++)
+                {
+                    Entry& entry = entries[job];
+                    entry.path = inputs[job].string();
+                    if (void* fp = file_access.open(entry.path.c_str()))
+                    {
+                        entry.valid = scanModule(file_access, fp, entry.info);
+                        file_access.close(fp);
+                    }
+                }
+            });
+        }
+    }
+
+    FILE* fp = fopen(output, "wb");
+    if (!fp)
+    {
+        printf("cannot create %s\n", output);
+        return 1;
+    }
+    const auto valid = static_cast<uint32_t>(std::count_if(entries.begin(), entries.end(),
+                                                           [](const Entry& entry) { return entry.valid; }));
+    IndexWriter writer{fp};
+    writer.put(index_magic, sizeof(index_magic));
+    writer.put(index_version);
+    writer.put(valid);
+    for (const Entry& entry : entries)
+    {
+        if (entry.valid)
+        {
+            writer.put(entry);
+        }
+        else
+        {
+            printf("%s: not an XM module\n", entry.path.c_str());
+        }
+    }
+    const bool closed = fclose(fp) == 0;
+    if (!writer.ok() || !closed)
+    {
+        printf("cannot write %s\n", output);
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%u of %zu modules indexed in %.2f s\n", valid, entries.size(), seconds);
+    return valid == entries.size() ? 0 : 1;
+}
@@ -0,0 +1,500 @@
+//===============================================================================================
+// minixm-render
+// Pan/SpinningKids, 2022-2025.
+//
+// Batch renders a list of XM files (or directories containing them) to WAV or raw PCM files,
+// using all the available cores. Every worker owns a single player/mixer context that is reused
+// for all the modules it renders, and idle workers steal pending files from the busy ones.
+//
+//===============================================================================================
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <minixm/system_file.h>
+#include <minixm/module.h>
+#include <minixm/player_state.h>
+#include <minixm/trace.h>
+
+namespace
+{
+    const minifmod::FileAccess& file_access = minifmod::stdio_file_access;
+
+    // Pull driver: nothing runs in the background, blocks are mixed only when the worker asks for them.
+    class RenderPlayback final : public IPlaybackDriver
+    {
+        FillFunction* fill_ = nullptr;
+        void* fill_arg_ = nullptr;
+        size_t current_block_ = 0;
+        uint64_t frames_rendered_ = 0;
+
+    public:
+        RenderPlayback(unsigned int mix_rate, unsigned int latency) :
+            IPlaybackDriver(mix_rate, latency, latency)
+        {
+        }
+
+        void start(FillFunction* fill, void* arg) override
+        {
+            fill_ = fill;
+            fill_arg_ = arg;
+            frames_rendered_ = 0;
+        }
+
+        void stop() override
+        {
+            fill_ = nullptr;
+        }
+
+        void render(short data[]) noexcept
+        {
+            current_block_ = (current_block_ + 1) % blocks();
+            fill_(fill_arg_, current_block_, data, block_size());
+            frames_rendered_ += block_size();
+        }
+
+        [[nodiscard]] uint64_t frames_played() const override
+        {
+            return frames_rendered_;
+        }
+    };
+
+    enum class OutputFormat
+    {
+        Wav,
+        Raw,
+    };
+
+    struct Options
+    {
+        unsigned int mix_rate = 48000;
+        unsigned int internal_rate = 0; // 0: mix at mix_rate
+        OutputFormat format = OutputFormat::Wav;
+        unsigned int threads = 0;
+        unsigned int max_seconds = 600;
+        ModuleLoadOptions load_options;
+        std::filesystem::path output_dir;
+        const char* trace_path = nullptr;
+    };
+
+    // little endian, whatever the host
+    void put16(unsigned char*& p, uint16_t v)
+    {
+        *p++ = static_cast<unsigned char>(v);
+        *p++ = static_cast<unsigned char>(v >> 8);
+    }
+
+    void put32(unsigned char*& p, uint32_t v)
+    {
+        put16(p, static_cast<uint16_t>(v));
+        put16(p, static_cast<uint16_t>(v >> 16));
+    }
+
+    void putTag(unsigned char*& p, const char* tag)
+    {
+        const size_t length = strlen(tag);
+        memcpy(p, tag, length);
+        p += length;
+    }
+
+    // errors show in ferror(fp)
+    void writeWavHeader(FILE* fp, uint32_t mix_rate, uint32_t data_bytes)
+    {
+        unsigned char header[44];
+        unsigned char* p = header;
+        putTag(p, "RIFF");
+        put32(p, 36 + data_bytes);
+        putTag(p, "WAVEfmt ");
+        put32(p, 16);
+        put16(p, 1); // PCM
+        put16(p, 2); // stereo
+        put32(p, mix_rate);
+        put32(p, mix_rate * 4);
+        put16(p, 4);
+        put16(p, 16);
+        putTag(p, "data");
+        put32(p, data_bytes);
+        fwrite(header, 1, sizeof(header), fp);
+    }
+
+    bool isValidHeader(const XMHeader& header)
+    {
+        return !memcmp(header.header, "Extended Module: ", sizeof(header.header)) &&
+            header.channels_count <= 32 &&
+            header.patterns_count <= 256 &&
+            header.instruments_count <= 128 &&
+            header.song_length > 0 && header.song_length <= 256;
+    }
+
+    // Work-stealing queue: the owner takes jobs from the back, thieves from the front.
+    class JobQueue
+    {
+        std::mutex mutex_;
+        std::deque<size_t> jobs_;
+
+    public:
+        void push(size_t job)
+        {
+            std::lock_guard lock{mutex_};
+            jobs_.push_back(job);
+        }
+
+        bool pop(size_t& job)
+        {
+            std::lock_guard lock{mutex_};
+            if (jobs_.empty()) return false;
+            job = jobs_.back();
+            jobs_.pop_back();
+            return true;
+        }
+
+        bool steal(size_t& job)
+        {
+            std::lock_guard lock{mutex_};
+            if (jobs_.empty()) return false;
+            job = jobs_.front();
+            jobs_.pop_front();
+            return true;
+        }
+    };
+
+    struct Totals
+    {
+        std::mutex mutex;
+        size_t files = 0;
+        size_t failed = 0;
+        double audio_seconds = 0;
+    };
+
+    class Worker
+    {
+        static constexpr unsigned int latency = 10;
+        static constexpr size_t io_buffer_size = 1 << 20;
+
+        const Options& options_;
+        RenderPlayback* playback_ = nullptr; // owned by player_
+        std::unique_ptr<IPlaybackDriver> driver_;
+        std::unique_ptr<PlayerState> player_;
+        std::unique_ptr<short[]> block_;
+        std::unique_ptr<char[]> io_buffer_;
+
+        std::unique_ptr<Module> load(const char* name)
+        {
+            void* fp = file_access.open(name);
+            if (!fp)
+            {
+                return {};
+            }
+            XMHeader header{};
+            if (file_access.read(&header, sizeof(header), fp) != sizeof(header) || !isValidHeader(header))
+            {
+                file_access.close(fp);
+                return {};
+            }
+            auto module = std::make_unique<Module>(file_access, fp, nullptr, options_.load_options);
+            file_access.close(fp);
+            return module;
+        }
+
+        // renders until the song jumps back to an order it already played, or until max_seconds
+        uint64_t render(FILE* out)
+        {
+            const uint64_t max_samples = static_cast<uint64_t>(options_.max_seconds) * options_.mix_rate;
+            std::bitset<256> visited_orders;
+            int last_order = 0;
+            visited_orders.set(0);
+
+            uint64_t samples = 0;
+            player_->start();
+            while (samples < max_samples)
+            {
+                playback_->render(block_.get());
+                if (fwrite(block_.get(), sizeof(short) * 2, playback_->block_size(), out) != playback_->block_size())
+                {
+                    break; // the caller finds it in ferror(out)
+                }
+                samples += playback_->block_size();
+
+                if (const int order = player_->getTimeInfo().position.order; order != last_order)
+                {
+                    if (visited_orders.test(order))
+                    {
+                        break;
+                    }
+                    visited_orders.set(order);
+                    last_order = order;
+                }
+            }
+            player_->stop();
+            return samples;
+        }
+
+    public:
+        explicit Worker(const Options& options) :
+            options_{options},
+            io_buffer_{std::make_unique_for_overwrite<char[]>(io_buffer_size)}
+        {
+            auto playback = std::make_unique<RenderPlayback>(options_.mix_rate, latency);
+            playback_ = playback.get();
+            block_ = std::make_unique_for_overwrite<short[]>(playback_->block_size() * 2);
+            driver_ = std::move(playback);
+        }
+
+        void process(const std::filesystem::path& input, Totals& totals)
+        {
+            const auto load_start = std::chrono::steady_clock::now();
+            auto module = load(input.string().c_str());
+            const auto load_end = std::chrono::steady_clock::now();
+
+            if (!module)
+            {
+                printf("%s: error loading song\n", input.string().c_str());
+                std::lock_guard lock{totals.mutex};
+                totals.failed++;
+                return;
+            }
+
+            // the previous module was already taken back by render(), so the player only needs rewinding
+            if (player_)
+            {
+                player_->reset(std::move(module));
+            }
+            else
+            {
+                player_ = std::make_unique<PlayerState>(std::move(driver_), std::move(module), options_.internal_rate);
+            }
+
+            std::filesystem::path output = options_.output_dir.empty()
+                                               ? input
+                                               : options_.output_dir / input.filename();
+            output.replace_extension(options_.format == OutputFormat::Wav ? ".wav" : ".raw");
+
+            FILE* out = fopen(output.string().c_str(), "wb");
+            if (!out)
+            {
+                printf("%s: cannot create %s\n", input.string().c_str(), output.string().c_str());
+                player_->stop();
+                std::lock_guard lock{totals.mutex};
+                totals.failed++;
+                return;
+            }
+            setvbuf(out, io_buffer_.get(), _IOFBF, io_buffer_size);
+            if (options_.format == OutputFormat::Wav)
+            {
+                writeWavHeader(out, options_.mix_rate, 0);
+            }
+
+            const auto render_start = std::chrono::steady_clock::now();
+            const uint64_t samples = render(out);
+            const auto render_end = std::chrono::steady_clock::now();
+
+            if (options_.format == OutputFormat::Wav)
+            {
+                fseek(out, 0, SEEK_SET);
+                writeWavHeader(out, options_.mix_rate, static_cast<uint32_t>(samples * sizeof(short) * 2));
+            }
+            const bool written = !ferror(out);
+            if (fclose(out) != 0 || !written)
+            {
+                printf("%s: cannot write %s\n", input.string().c_str(), output.string().c_str());
+                std::lock_guard lock{totals.mutex};
+                totals.failed++;
+                return;
+            }
+
+            const double audio_seconds = static_cast<double>(samples) / options_.mix_rate;
+            const double load_ms = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+            const double render_ms = std::chrono::duration<double, std::milli>(render_end - render_start).count();
+            printf("%s: load %8.2f ms, render %9.2f ms, %7.2f s audio, %8.1fx realtime\n",
+                   input.string().c_str(), load_ms, render_ms, audio_seconds,
+                   render_ms > 0 ? audio_seconds * 1000.0 / render_ms : 0.0);
+
+            std::lock_guard lock{totals.mutex};
+            totals.files++;
+            totals.audio_seconds += audio_seconds;
+        }
+    };
+
+    bool isModule(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().string();
+        for (auto& c : extension)
+        {
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+        return extension == ".xm";
+    }
+
+    void printUsage()
+    {
+        printf("-------------------------------------------------------------\n");
+        printf("MINIXM batch renderer.\n");
+        printf("Pan/SpinningKids, 2022-2025.\n");
+        printf("-------------------------------------------------------------\n");
+        printf("Syntax: minixm-render [options] file.xm|directory ...\n\n");
+        printf("  -r <rate>     output rate in Hz (default 48000)\n");
+        printf("  -m <rate>     internal mixing rate in Hz, resampled to the output rate (default: same)\n");
+        printf("  -i linear|mip sample interpolation, mip filters high notes through mip maps (default linear)\n");
+        printf("  -s pcm|adpcm  sample storage, adpcm is lossy and takes a quarter of the memory (default pcm)\n");
+        printf("  -f wav|raw    output format (default wav, raw is 16 bit stereo PCM)\n");
+        printf("  -o <dir>      output directory (default: next to each input file)\n");
+        printf("  -j <threads>  number of worker threads (default: all cores)\n");
+        printf("  -t <seconds>  maximum length of each rendering (default 600)\n");
+        printf("  -T <file>     write a Chrome trace of the rendering (needs minixm built with MINIXM_TRACE)\n\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2] && i + 1 < argc)
+        {
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'r':
+                options.mix_rate = static_cast<unsigned int>(atoi(value));
+                break;
+            case 'm':
+                options.internal_rate = static_cast<unsigned int>(atoi(value));
+                break;
+            case 'i':
+                options.load_options.mip_maps = !strcmp(value, "mip");
+                break;
+            case 's':
+                options.load_options.adpcm = !strcmp(value, "adpcm");
+                break;
+            case 'f':
+                options.format = strcmp(value, "raw") ? OutputFormat::Wav : OutputFormat::Raw;
+                break;
+            case 'o':
+                options.output_dir = value;
+                break;
+            case 'j':
+                options.threads = static_cast<unsigned int>(atoi(value));
+                break;
+            case 't':
+                options.max_seconds = static_cast<unsigned int>(atoi(value));
+                break;
+            case 'T':
+                options.trace_path = value;
+                break;
+            default:
+                printUsage();
+                return 1;
+            }
+            continue;
+        }
+
+        std::error_code ec;
+        if (std::filesystem::is_directory(arg, ec))
+        {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(arg, ec))
+            {
+                if (entry.is_regular_file() && isModule(entry.path()))
+                {
+                    inputs.push_back(entry.path());
+                }
+            }
+        }
+        else
+        {
+            inputs.emplace_back(arg);
+        }
+    }
+
+    if (inputs.empty() || options.mix_rate < 8000 || (options.internal_rate && options.internal_rate < 8000))
+    {
+        printUsage();
+        return inputs.empty() ? 0 : 1;
+    }
+
+    if (!options.output_dir.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(options.output_dir, ec);
+    }
+
+    const unsigned int threads = std::max(1u, std::min(options.threads ? options.threads
+                                                                       : std::thread::hardware_concurrency(),
+                                                       static_cast<unsigned int>(inputs.size())));
+
+    // deal the files round-robin, idle workers will then steal from the others
+    std::vector<JobQueue> queues(threads);
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        queues[i % threads].push(i);
+    }
+
+    std::unique_ptr<TraceExporter> trace;
+    if (options.trace_path)
+    {
+        if (!TraceExporter::enabled)
+        {
+            printf("minixm was built without MINIXM_TRACE, %s will be empty\n", options.trace_path);
+        }
+        trace = std::make_unique<TraceExporter>(options.trace_path);
+        if (!trace->open())
+        {
+            printf("cannot write %s\n", options.trace_path);
+            trace.reset();
+        }
+    }
+
+    Totals totals;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned int worker_index = 0; worker_index < threads; ++worker_index)
+        {
+            workers.emplace_back([&, worker_index]
+            {
+                Worker worker{options};
+                size_t job;
+                while (true)
+                {
+                    bool found = queues[worker_index].pop(job);
+                    for (unsigned int victim = 1; !found && victim < threads; ++victim)
+                    {
+                        found = queues[(worker_index + victim) % threads].steal(job);
+                    }
+                    if (!found)
+                    {
+                        break;
+                    }
+                    worker.process(inputs[job], totals);
+                }
+            });
+        }
+    }
+    const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (trace)
+    {
+        trace->stop();
+        printf("%llu trace events written to %s (%llu dropped)\n", static_cast<unsigned long long>(trace->written()),
+               options.trace_path, static_cast<unsigned long long>(trace->dropped()));
+    }
+
+    printf("=========================================================================\n");
+    printf("%zu files rendered (%zu failed) with %u threads, %.2f s audio in %.2f s, %.1fx realtime\n",
+           totals.files, totals.failed, threads, totals.audio_seconds, wall_seconds,
+           wall_seconds > 0 ? totals.audio_seconds / wall_seconds : 0.0);
+
+    return totals.failed ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+/******************************************************************************/
+//             alsa_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <minixm/playback.h>
+#include <minixm/seqlock.h>
+#include <alsa/asoundlib.h>
+
+// Direct ALSA output: blocks are mixed straight into the mmap'ed hardware ring.
+// One block is one period, so latency is period_ms * periods (down to 1-2 ms periods on decent hardware).
+// Float output is preferred when the device takes it, then 32 and 16 bit.
+// Any PCM name works, e.g. "hw:0", "default", or "null" for testing without a sound card.
+class AlsaPlayback final : public IPlaybackDriver {
+public:
+    AlsaPlayback(unsigned int mix_rate, const char* device = "default", unsigned int period_ms = 2,
+                 unsigned int periods = 4, std::pmr::memory_resource* memory = nullptr);
+    ~AlsaPlayback() override;
+
+    void start(FillFunction* fill, void* arg) override;
+    void stop() override;
+    uint64_t frames_played() const override;
+    uint64_t underruns() const override;
+
+private:
+    void run(FillFunction* fill, void* arg);
+    bool writeBlock(FillFunction* fill, void* arg);
+    void updatePosition();
+
+    snd_pcm_t* pcm_;
+    snd_pcm_uframes_t buffer_frames_;
+    ResourceArray<char> bounce_buffer_; // only used when the ring wraps inside a block
+
+    using clock = std::chrono::steady_clock;
+
+    // what snd_pcm_delay said last time, extrapolated by the readers until the next update
+    struct PlayedSnapshot {
+        uint64_t frames;
+        uint64_t frames_written;
+        clock::rep time;
+        bool running;
+    };
+
+    uint64_t frames_written_;
+    SeqLock<PlayedSnapshot> played_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> underruns_{0};
+};
@@ -0,0 +1,219 @@
+/******************************************************************************/
+//             alsa_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#include <alsa_playback/alsa_playback.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+AlsaPlayback::AlsaPlayback(unsigned int mix_rate, const char* device, unsigned int period_ms, unsigned int periods,
+                           std::pmr::memory_resource* memory)
+    : IPlaybackDriver(mix_rate, period_ms * periods, period_ms, memory),
+      pcm_(nullptr),
+      buffer_frames_(0),
+      frames_written_(0),
+      running_(false)
+{
+    if (snd_pcm_open(&pcm_, device, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+        pcm_ = nullptr;
+        return;
+    }
+
+    snd_pcm_hw_params_t* hw_params;
+    snd_pcm_hw_params_alloca(&hw_params);
+    snd_pcm_uframes_t period_frames = block_size();
+    buffer_frames_ = static_cast<snd_pcm_uframes_t>(block_size()) * periods;
+
+    bool ok = snd_pcm_hw_params_any(pcm_, hw_params) >= 0 &&
+        snd_pcm_hw_params_set_access(pcm_, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0;
+
+    // the best format the device takes natively: float needs no conversion at all
+    struct {
+        snd_pcm_format_t alsa;
+        SampleFormat mixer;
+    } constexpr formats[] = {
+        {SND_PCM_FORMAT_FLOAT_LE, SampleFormat::F32},
+        {SND_PCM_FORMAT_S32_LE, SampleFormat::S32},
+        {SND_PCM_FORMAT_S16_LE, SampleFormat::S16},
+    };
+    snd_pcm_format_t format = SND_PCM_FORMAT_S16_LE;
+    for (const auto& candidate : formats) {
+        if (ok && snd_pcm_hw_params_test_format(pcm_, hw_params, candidate.alsa) == 0) {
+            format = candidate.alsa;
+            setSampleFormat(candidate.mixer);
+            break;
+        }
+    }
+
+    ok = ok &&
+        snd_pcm_hw_params_set_format(pcm_, hw_params, format) >= 0 &&
+        snd_pcm_hw_params_set_channels(pcm_, hw_params, 2) >= 0 &&
+        snd_pcm_hw_params_set_rate_resample(pcm_, hw_params, 1) >= 0 &&
+        snd_pcm_hw_params_set_rate(pcm_, hw_params, mix_rate, 0) >= 0 &&
+        snd_pcm_hw_params_set_period_size_near(pcm_, hw_params, &period_frames, nullptr) >= 0 &&
+        snd_pcm_hw_params_set_buffer_size_near(pcm_, hw_params, &buffer_frames_) >= 0 &&
+        snd_pcm_hw_params(pcm_, hw_params) >= 0;
+
+    if (ok) {
+        // wake up as soon as a whole block fits, start only when the ring is full
+        snd_pcm_sw_params_t* sw_params;
+        snd_pcm_sw_params_alloca(&sw_params);
+        ok = snd_pcm_sw_params_current(pcm_, sw_params) >= 0 &&
+            snd_pcm_sw_params_set_avail_min(pcm_, sw_params, block_size()) >= 0 &&
+            snd_pcm_sw_params_set_start_threshold(pcm_, sw_params, buffer_frames_ / block_size() * block_size()) >= 0 &&
+            snd_pcm_sw_params(pcm_, sw_params) >= 0;
+    }
+
+    // the hardware may round the ring down, but we need at least two blocks in it
+    if (!ok || buffer_frames_ < 2 * static_cast<snd_pcm_uframes_t>(block_size())) {
+        snd_pcm_close(pcm_);
+        pcm_ = nullptr;
+        return;
+    }
+    bounce_buffer_ = makeResourceArray<char>(memory_resource(), static_cast<size_t>(block_size()) * frame_bytes());
+}
+
+AlsaPlayback::~AlsaPlayback()
+{
+    stop();
+    if (pcm_) {
+        snd_pcm_close(pcm_);
+        pcm_ = nullptr;
+    }
+}
+
+void AlsaPlayback::start(FillFunction* fill, void* arg)
+{
+    if (!pcm_ || thread_.joinable()) {
+        return;
+    }
+
+    frames_written_ = 0;
+    underruns_ = 0;
+    played_.store({});
+    running_ = true;
+    thread_ = std::thread([this, fill, arg] { run(fill, arg); });
+}
+
+void AlsaPlayback::stop()
+{
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+        snd_pcm_drop(pcm_);
+    }
+}
+
+void AlsaPlayback::run(FillFunction* fill, void* arg)
+{
+    snd_pcm_prepare(pcm_);
+
+    while (running_) {
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_);
+        if (avail < 0) {
+            // underrun (or suspend): start again from an empty ring
+            if (avail == -EPIPE) {
+                underruns_++;
+            }
+            if (snd_pcm_recover(pcm_, static_cast<int>(avail), 1) < 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (avail < static_cast<snd_pcm_sframes_t>(block_size())) {
+            if (snd_pcm_state(pcm_) == SND_PCM_STATE_PREPARED) {
+                // the ring is full but the start threshold wasn't hit (it was rounded): kick it
+                snd_pcm_start(pcm_);
+            }
+            snd_pcm_wait(pcm_, 100);
+            updatePosition();
+            continue;
+        }
+
+        if (!writeBlock(fill, arg)) {
+            continue;
+        }
+        updatePosition();
+    }
+}
+
+bool AlsaPlayback::writeBlock(FillFunction* fill, void* arg)
+{
+    const size_t block = static_cast<size_t>((frames_written_ / block_size()) % blocks());
+    const snd_pcm_channel_area_t* areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = block_size();
+
+    if (snd_pcm_mmap_begin(pcm_, &areas, &offset, &frames) < 0) {
+        return false;
+    }
+
+    auto ring_address = [&areas](snd_pcm_uframes_t frame_offset) {
+        // interleaved: one area per channel, all sharing the same address and step (in bits)
+        return static_cast<char*>(areas[0].addr) + (areas[0].first + frame_offset * areas[0].step) / 8;
+    };
+
+    if (frames == block_size()) {
+        // the whole block is contiguous: mix straight into the hardware ring
+        fill(arg, block, ring_address(offset), block_size());
+        if (snd_pcm_mmap_commit(pcm_, offset, frames) < 0) {
+            return false;
+        }
+    }
+    else {
+        // the ring wraps inside this block: mix aside and copy the two halves
+        fill(arg, block, bounce_buffer_.get(), block_size());
+        snd_pcm_uframes_t copied = 0;
+        while (true) {
+            memcpy(ring_address(offset), bounce_buffer_.get() + copied * frame_bytes(), frames * frame_bytes());
+            if (snd_pcm_mmap_commit(pcm_, offset, frames) < 0) {
+                return false;
+            }
+            copied += frames;
+            if (copied == block_size()) {
+                break;
+            }
+            frames = block_size() - copied;
+            if (snd_pcm_mmap_begin(pcm_, &areas, &offset, &frames) < 0) {
+                return false;
+            }
+        }
+    }
+
+    frames_written_ += block_size();
+    return true;
+}
+
+void AlsaPlayback::updatePosition()
+{
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay(pcm_, &delay) == 0 && delay >= 0 && static_cast<uint64_t>(delay) <= frames_written_) {
+        played_.store({
+            frames_written_ - delay,
+            frames_written_,
+            clock::now().time_since_epoch().count(),
+            snd_pcm_state(pcm_) == SND_PCM_STATE_RUNNING,
+        });
+    }
+}
+
+uint64_t AlsaPlayback::frames_played() const
+{
+    const PlayedSnapshot played = played_.load();
+    if (!played.running) {
+        return played.frames;
+    }
+    // the device keeps going at mix_rate() between our updates, but can't play what we haven't written
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock::now() - clock::time_point{clock::duration{played.time}}).count();
+    const uint64_t advance = static_cast<uint64_t>(std::max<int64_t>(elapsed, 0)) * mix_rate() / 1000000ull;
+    return std::min(played.frames + advance, played.frames_written);
+}
+
+uint64_t AlsaPlayback::underruns() const
+{
+    return underruns_;
+}
@@ -0,0 +1,62 @@
+/******************************************************************************/
+//             file_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <minixm/playback.h>
+
+// Renders to a WAV or raw 16 bit stereo file as fast as the mixer can go.
+// Blocks are mixed on one thread and written by another, in large writes from a page-aligned ring.
+class FileWriterPlayback final : public IPlaybackDriver {
+public:
+    enum class Format {
+        Wav,
+        Raw,
+    };
+
+    // length is in samples, 0 means "until stop()"
+    FileWriterPlayback(const char* filename, unsigned int mix_rate, Format format = Format::Wav, uint64_t length = 0,
+                       unsigned int buffer_size_ms = 1000, unsigned int latency = 20,
+                       std::pmr::memory_resource* memory = nullptr);
+    ~FileWriterPlayback() override;
+
+    void start(FillFunction* fill, void* arg) override;
+    void stop() override;
+    uint64_t frames_played() const override;
+
+    // true when the file could not be created
+    [[nodiscard]] bool failed() const noexcept { return !file_; }
+    // true when length samples have been written (or writing failed)
+    [[nodiscard]] bool finished() const noexcept { return finished_; }
+
+private:
+    static constexpr size_t alignment = 4096;
+
+    void produce(FillFunction* fill, void* arg);
+    void write();
+    void writeHeader(uint64_t data_bytes);
+
+    FILE* file_;
+    Format format_;
+    uint64_t length_;
+    ResourceArray<short> ring_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t blocks_filled_;
+    std::atomic<uint64_t> blocks_written_; // virtual clock, read by frames_played()
+    bool producing_;
+
+    std::atomic<bool> running_;
+    std::atomic<bool> finished_;
+    std::thread producer_thread_;
+    std::thread writer_thread_;
+};
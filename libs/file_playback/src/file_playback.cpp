@@ -0,0 +1,188 @@
+/******************************************************************************/
+//             file_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#include <file_playback/file_playback.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace
+{
+    // The WAV header is padded with a JUNK chunk to one page, so that sample data starts page-aligned.
+    constexpr size_t wav_header_size = 4096;
+
+    void put16(unsigned char*& p, uint16_t v)
+    {
+        memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    }
+
+    void put32(unsigned char*& p, uint32_t v)
+    {
+        memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    }
+
+    void putTag(unsigned char*& p, const char (&tag)[5])
+    {
+        memcpy(p, tag, 4);
+        p += 4;
+    }
+}
+
+FileWriterPlayback::FileWriterPlayback(const char* filename, unsigned int mix_rate, Format format, uint64_t length,
+                                       unsigned int buffer_size_ms, unsigned int latency,
+                                       std::pmr::memory_resource* memory)
+    : IPlaybackDriver(mix_rate, buffer_size_ms, latency, memory),
+      file_(fopen(filename, "wb")),
+      format_(format),
+      length_(length),
+      blocks_filled_(0),
+      blocks_written_(0),
+      producing_(false),
+      running_(false),
+      finished_(false)
+{
+    const size_t ring_bytes = (buffer_size() * 2 * sizeof(short) + alignment - 1) & ~(alignment - 1);
+    ring_ = makeResourceArray<short>(memory_resource(), ring_bytes / sizeof(short), alignment);
+
+    if (file_) {
+        // every fwrite goes straight to the OS, the ring is our buffer
+        setvbuf(file_, nullptr, _IONBF, 0);
+        if (format_ == Format::Wav) {
+            writeHeader(0);
+        }
+    }
+}
+
+FileWriterPlayback::~FileWriterPlayback()
+{
+    stop();
+}
+
+void FileWriterPlayback::writeHeader(uint64_t data_bytes)
+{
+    const auto data_size = static_cast<uint32_t>(std::min<uint64_t>(data_bytes, 0xFFFFFFFFu - wav_header_size));
+
+    unsigned char header[wav_header_size]{};
+    unsigned char* p = header;
+    putTag(p, "RIFF");
+    put32(p, static_cast<uint32_t>(wav_header_size - 8 + data_size));
+    putTag(p, "WAVE");
+    putTag(p, "fmt ");
+    put32(p, 16);
+    put16(p, 1); // PCM
+    put16(p, 2); // stereo
+    put32(p, mix_rate());
+    put32(p, mix_rate() * 4);
+    put16(p, 4);
+    put16(p, 16);
+    putTag(p, "JUNK");
+    put32(p, static_cast<uint32_t>(header + wav_header_size - 8 - (p + 4)));
+    p = header + wav_header_size - 8;
+    putTag(p, "data");
+    put32(p, data_size);
+
+    fseek(file_, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), file_);
+}
+
+void FileWriterPlayback::start(FillFunction* fill, void* arg)
+{
+    if (!file_ || producer_thread_.joinable()) {
+        return;
+    }
+
+    running_ = true;
+    producing_ = true;
+    producer_thread_ = std::thread([this, fill, arg] { produce(fill, arg); });
+    writer_thread_ = std::thread([this] { write(); });
+}
+
+void FileWriterPlayback::stop()
+{
+    running_ = false;
+    cv_.notify_all();
+    if (producer_thread_.joinable()) producer_thread_.join();
+    if (writer_thread_.joinable()) writer_thread_.join();
+
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+void FileWriterPlayback::produce(FillFunction* fill, void* arg)
+{
+    const size_t block_samples = block_size() * 2;
+
+    std::unique_lock lock{mutex_};
+    while (running_ && (!length_ || blocks_filled_ * block_size() < length_)) {
+        if (blocks_filled_ - blocks_written_ >= blocks()) {
+            cv_.wait(lock);
+            continue;
+        }
+        const size_t block = blocks_filled_ % blocks();
+        lock.unlock();
+
+        fill(arg, block, ring_.get() + block * block_samples, block_size());
+
+        lock.lock();
+        ++blocks_filled_;
+        cv_.notify_all();
+    }
+    producing_ = false;
+    cv_.notify_all();
+}
+
+void FileWriterPlayback::write()
+{
+    const size_t block_bytes = block_size() * 2 * sizeof(short);
+    // don't bother the OS for less than half the ring, unless we are draining it
+    const uint64_t batch = std::max(blocks() / 2, 1u);
+    const uint64_t total_bytes = length_ * 2 * sizeof(short);
+    uint64_t bytes_written = 0;
+    bool write_failed = false;
+
+    std::unique_lock lock{mutex_};
+    while (true) {
+        cv_.wait(lock, [&] { return blocks_filled_ - blocks_written_ >= batch || !producing_; });
+        const uint64_t first = blocks_written_;
+        if (first == blocks_filled_) {
+            break; // !producing_ and nothing left
+        }
+        // contiguous run up to the end of the ring
+        const uint64_t count = std::min(blocks_filled_ - first, blocks() - first % blocks());
+        lock.unlock();
+
+        size_t bytes = count * block_bytes;
+        if (length_) {
+            bytes = static_cast<size_t>(std::min<uint64_t>(bytes, total_bytes - bytes_written));
+        }
+        if (!write_failed) {
+            write_failed = fwrite(reinterpret_cast<const char*>(ring_.get()) + (first % blocks()) * block_bytes, 1,
+                                  bytes, file_) != bytes;
+            bytes_written += bytes;
+            finished_ = write_failed;
+        }
+
+        lock.lock();
+        blocks_written_ = first + count;
+        cv_.notify_all();
+    }
+    lock.unlock();
+
+    if (format_ == Format::Wav) {
+        writeHeader(bytes_written);
+    }
+    fflush(file_);
+    finished_ = true;
+}
+
+uint64_t FileWriterPlayback::frames_played() const
+{
+    // whatever hit the file has been "played"
+    return blocks_written_ * block_size();
+}
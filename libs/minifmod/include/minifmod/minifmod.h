@@ -140,6 +140,13 @@ bool FMUSIC_FreeSong(Module* module);
 PlayerState* FMUSIC_PlaySong(Module* module);
 Module* FMUSIC_StopSong(PlayerState* player_state = nullptr);
 
+// Callbacks, set before FMUSIC_PlaySong and called on a thread of their own as the music is heard.
+// =================================================================================================
+
+bool FMUSIC_SetZxxCallback(Module* module, FMUSIC_CALLBACK callback);
+bool FMUSIC_SetRowCallback(Module* module, FMUSIC_CALLBACK callback, int rowstep);
+bool FMUSIC_SetOrderCallback(Module* module, FMUSIC_CALLBACK callback, int orderstep);
+
 // Runtime song information.
 // =========================
 
@@ -26,6 +26,83 @@ namespace
 {
     unsigned int FSOUND_MixRate = 96000;
     PlayerState* FSOUND_last_player_state = nullptr;
+
+    // callbacks for the module that will be played next
+    struct
+    {
+        Module* module;
+        FMUSIC_CALLBACK zxx;
+        FMUSIC_CALLBACK row;
+        FMUSIC_CALLBACK order;
+        int row_step;
+        int order_step;
+        PlayerState* player_state; // the callbacks' first argument
+        int last_order; // of the last row heard, -1 before the first
+    } FMUSIC_callbacks{};
+
+    // the C API's file callbacks, set by FSOUND_File_SetCallbacks, and the I/O context FMUSIC_LoadSong uses them by
+    struct
+    {
+        void* (*open)(const char* name);
+        void (*close)(void* handle);
+        size_t (*read)(void* buffer, size_t size, void* handle);
+        void (*seek)(void* handle, long pos, int mode);
+        long (*tell)(void* handle);
+    } FSOUND_file_callbacks{};
+
+    const minifmod::FileAccess FSOUND_file_access{
+        [](void*, const char* name) { return FSOUND_file_callbacks.open(name); },
+        [](void*, void* handle) { FSOUND_file_callbacks.close(handle); },
+        [](void*, void* buffer, size_t count, void* handle) { return FSOUND_file_callbacks.read(buffer, count, handle); },
+        [](void*, void* handle, long pos, int mode) { FSOUND_file_callbacks.seek(handle, pos, mode); },
+        [](void*, void* handle) { return FSOUND_file_callbacks.tell(handle); },
+    };
+
+    void FMUSIC_Dispatch(void*, const PlayerEvent& event)
+    {
+        const auto& callbacks = FMUSIC_callbacks;
+        switch (event.type)
+        {
+        case PlayerEvent::SYNC:
+            if (callbacks.zxx)
+            {
+                callbacks.zxx(callbacks.player_state, static_cast<unsigned char>(event.param));
+            }
+            break;
+        case PlayerEvent::ROW:
+            if (callbacks.row && event.position.row % callbacks.row_step == 0)
+            {
+                callbacks.row(callbacks.player_state, static_cast<unsigned char>(event.position.row));
+            }
+            // on entering an order, at whatever row a pattern break lands on; a pattern loop stays in it
+            if (event.position.order != FMUSIC_callbacks.last_order)
+            {
+                FMUSIC_callbacks.last_order = event.position.order;
+                if (callbacks.order && event.position.order % callbacks.order_step == 0)
+                {
+                    callbacks.order(callbacks.player_state, static_cast<unsigned char>(event.position.order));
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool FMUSIC_SetCallback(Module* module, FMUSIC_CALLBACK& slot, FMUSIC_CALLBACK callback)
+    {
+        if (!module)
+        {
+            return false;
+        }
+        if (FMUSIC_callbacks.module != module)
+        {
+            FMUSIC_callbacks = {};
+            FMUSIC_callbacks.module = module;
+        }
+        slot = callback;
+        return true;
+    }
 }
 
 //= API FUNCTIONS ==============================================================================
@@ -50,11 +127,11 @@ namespace
 */
 Module* FMUSIC_LoadSong(const char* name, SAMPLE_LOAD_CALLBACK sample_load_callback)
 {
-    if (void* fp = minifmod::file_access.open(name))
+    if (void* fp = FSOUND_file_access.open(name))
     {
         // create a mod instance
-        auto mod = std::make_unique<Module>(minifmod::file_access, fp, sample_load_callback);
-        minifmod::file_access.close(fp);
+        auto mod = std::make_unique<Module>(FSOUND_file_access, fp, sample_load_callback);
+        FSOUND_file_access.close(fp);
         return mod.release();
     }
     return {};
@@ -82,6 +159,7 @@ bool FMUSIC_FreeSong(Module* module)
 {
     if (module)
     {
+        if (FMUSIC_callbacks.module == module) FMUSIC_callbacks = {};
         delete module;
         return true;
     }
@@ -121,6 +199,12 @@ PlayerState* FMUSIC_PlaySong(Module* module)
     playback = std::make_unique<PulseAudioPlayback>(FSOUND_MixRate);
 #endif
     FSOUND_last_player_state = new PlayerState(std::move(playback), std::unique_ptr<Module>{module});
+    if (FMUSIC_callbacks.module == module)
+    {
+        FMUSIC_callbacks.player_state = FSOUND_last_player_state;
+        FMUSIC_callbacks.last_order = -1;
+        FSOUND_last_player_state->setEventCallback(&FMUSIC_Dispatch, nullptr, PlayerEvent::ROW | PlayerEvent::SYNC);
+    }
     FSOUND_last_player_state->start();
     return FSOUND_last_player_state;
 }
@@ -152,11 +236,100 @@ Module* FMUSIC_StopSong(PlayerState* player_state)
     {
         module = player_state->stop();
         if (FSOUND_last_player_state == player_state) FSOUND_last_player_state = nullptr;
+        if (FMUSIC_callbacks.player_state == player_state) FMUSIC_callbacks.player_state = nullptr;
         delete player_state;
     }
     return module.release();
 }
 
+/*
+[API]
+[
+    [DESCRIPTION]
+    Sets a callback for every Zxx effect in the song (Zxx does nothing in XM playback).
+
+    [PARAMETERS]
+    'mod'		Pointer to the song, before FMUSIC_PlaySong.
+    'callback'	Called with the xx parameter, on a separate thread, when the row is heard.
+
+    [RETURN_VALUE]
+    true		on success
+    false		on failure
+
+    [REMARKS]
+    Only one song at a time can have callbacks.
+
+    [SEE_ALSO]
+    FMUSIC_SetRowCallback, FMUSIC_SetOrderCallback
+]
+*/
+bool FMUSIC_SetZxxCallback(Module* module, FMUSIC_CALLBACK callback)
+{
+    return FMUSIC_SetCallback(module, FMUSIC_callbacks.zxx, callback);
+}
+
+/*
+[API]
+[
+    [DESCRIPTION]
+    Sets a callback for every 'rowstep' rows of the song.
+
+    [PARAMETERS]
+    'mod'		Pointer to the song, before FMUSIC_PlaySong.
+    'callback'	Called with the row number, on a separate thread, when the row is heard.
+    'rowstep'	1 for every row, 4 for every 4th row, etc.
+
+    [RETURN_VALUE]
+    true		on success
+    false		on failure
+
+    [REMARKS]
+
+    [SEE_ALSO]
+    FMUSIC_SetZxxCallback, FMUSIC_SetOrderCallback
+]
+*/
+bool FMUSIC_SetRowCallback(Module* module, FMUSIC_CALLBACK callback, int rowstep)
+{
+    if (rowstep <= 0 || !FMUSIC_SetCallback(module, FMUSIC_callbacks.row, callback))
+    {
+        return false;
+    }
+    FMUSIC_callbacks.row_step = rowstep;
+    return true;
+}
+
+/*
+[API]
+[
+    [DESCRIPTION]
+    Sets a callback for every 'orderstep' orders of the song.
+
+    [PARAMETERS]
+    'mod'		Pointer to the song, before FMUSIC_PlaySong.
+    'callback'	Called with the order number, on a separate thread, when the first row played in it is heard.
+    'orderstep'	1 for every order, 2 for every other order, etc.
+
+    [RETURN_VALUE]
+    true		on success
+    false		on failure
+
+    [REMARKS]
+
+    [SEE_ALSO]
+    FMUSIC_SetZxxCallback, FMUSIC_SetRowCallback
+]
+*/
+bool FMUSIC_SetOrderCallback(Module* module, FMUSIC_CALLBACK callback, int orderstep)
+{
+    if (orderstep <= 0 || !FMUSIC_SetCallback(module, FMUSIC_callbacks.order, callback))
+    {
+        return false;
+    }
+    FMUSIC_callbacks.order_step = orderstep;
+    return true;
+}
+
 //= INFORMATION FUNCTIONS ======================================================================
 
 /*
@@ -249,9 +422,9 @@ void FSOUND_File_SetCallbacks(void* (*OpenCallback)(const char* name),
                               void (*SeekCallback)(void*, long pos, int mode),
                               long (*TellCallback)(void* handle)) noexcept
 {
-    minifmod::file_access.open = OpenCallback;
-    minifmod::file_access.close = CloseCallback;
-    minifmod::file_access.read = ReadCallback;
-    minifmod::file_access.seek = SeekCallback;
-    minifmod::file_access.tell = TellCallback;
+    FSOUND_file_callbacks.open = OpenCallback;
+    FSOUND_file_callbacks.close = CloseCallback;
+    FSOUND_file_callbacks.read = ReadCallback;
+    FSOUND_file_callbacks.seek = SeekCallback;
+    FSOUND_file_callbacks.tell = TellCallback;
 }
@@ -0,0 +1,25 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+// IMA ADPCM in independent blocks, so that any block can be decoded on its own: 4 bits a frame, lossy.
+// A block is the frame before it, the step index and a spare byte, then two frames a byte, low nibble first.
+namespace adpcm
+{
+    constexpr uint32_t block_frames = 64;
+    constexpr uint32_t block_bytes = 4 + block_frames / 2;
+
+    [[nodiscard]] constexpr uint32_t blockCount(uint32_t frames) noexcept
+    {
+        return (frames + block_frames - 1) / block_frames;
+    }
+
+    // encodes frames into blockCount(frame_count) blocks, padding the last one with its final frame
+    void encode(const int16_t frames[], uint32_t frame_count, uint8_t blocks[]) noexcept;
+
+    void decodeBlock(const uint8_t block[], int16_t frames[block_frames]) noexcept;
+}
@@ -0,0 +1,81 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "memory.h"
+#include "position.h"
+
+class Mixer;
+
+struct PlayerEvent final
+{
+    // also used as bits of the mask passed to EventStream::setCallback
+    enum Type : uint32_t
+    {
+        ROW = 1 << 0, // first tick of a row
+        TICK = 1 << 1, // every tick, rows included
+        NOTE = 1 << 2, // a note was triggered on channel, param is the note
+        SYNC = 1 << 3, // a Zxx effect (unused by XM playback) on channel, param is xx
+    };
+
+    Type type;
+    int tick;
+    Position position;
+    int channel;
+    int param;
+    uint64_t frame; // when it is heard, on the same clock as TimeInfo::samples
+};
+
+// Events are queued on the mixing thread (lock-free, never blocking) and handed to the callback
+// on a thread of their own, each one when the sample it refers to is being played.
+class EventStream final
+{
+public:
+    using Callback = void(void* context, const PlayerEvent& event);
+
+private:
+    static constexpr uint32_t capacity = 1024; // events in flight, the rest are dropped
+
+    Callback* callback_ = nullptr;
+    void* context_ = nullptr;
+    uint32_t mask_ = 0;
+
+    std::pmr::memory_resource* memory_ = nullptr;
+    ResourceArray<PlayerEvent> ring_;
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> read_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint32_t> signal_{0}; // bumped to wake the dispatcher up
+
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    void dispatch(const Mixer& mixer);
+
+public:
+    explicit EventStream(std::pmr::memory_resource* memory = nullptr) noexcept : memory_{memory} {}
+    EventStream(const EventStream&) = delete;
+    EventStream& operator =(const EventStream&) = delete;
+    ~EventStream();
+
+    // must be called while stopped, a null callback or empty mask turns events off
+    void setCallback(Callback* callback, void* context, uint32_t mask) noexcept;
+
+    [[nodiscard]] bool wants(PlayerEvent::Type type) const noexcept { return mask_ & type; }
+
+    // mixing thread only
+    void push(const PlayerEvent& event) noexcept;
+
+    void start(const Mixer& mixer);
+    void stop();
+
+    // events lost because the consumer couldn't keep up
+    [[nodiscard]] uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,75 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+
+#include "seqlock.h"
+
+// what the mixer gives up at a governor level
+struct GovernorLevel final
+{
+    float nearest_below; // voices quieter than this (1: a full volume channel) are mixed without interpolation
+    uint32_t max_voices; // the quietest voices past this many are ramped out and played virtually
+};
+
+struct GovernorStatus final
+{
+    int level; // 0: full quality
+    float load; // time taken to mix a block over the time it plays for, smoothed
+    uint64_t overruns; // blocks that took longer to mix than to play
+    uint64_t level_changes;
+    uint32_t voices_nearest; // as of the last block: voices mixed without interpolation
+    uint32_t voices_culled; // and voices culled to stay within max_voices
+};
+
+// Keeps the mixer within its deadline on busy hosts: measures how long each block takes to mix against how long
+// it plays for, steps quality down a level when that gets close, and back up after a while with room to spare.
+// Offline rendering mixes far faster than real time, so it stays at full quality.
+class Governor final
+{
+public:
+    static constexpr GovernorLevel levels[] = {
+        {0.f, 64},
+        {1.f / 16, 64},
+        {1.f / 16, 32},
+        {1.f / 8, 16},
+    };
+    static constexpr int max_level = static_cast<int>(std::size(levels)) - 1;
+
+    static constexpr float step_down_load = 0.75f; // of the block's duration
+    static constexpr float step_up_load = 0.35f;
+    static constexpr uint32_t settle_blocks = 16; // after a change, before stepping down again
+    static constexpr uint32_t calm_blocks = 256; // under step_up_load, before stepping up
+
+private:
+    std::atomic<bool> enabled_{true};
+    GovernorStatus status_{};
+    uint32_t since_change_ = 0;
+    uint32_t calm_ = 0;
+    SeqLock<GovernorStatus> published_;
+
+public:
+    // any thread; disabled, the mixer runs at full quality
+    void setEnabled(bool enabled) noexcept { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // the mixing thread: the level to mix at
+    [[nodiscard]] const GovernorLevel& level() const noexcept { return levels[status_.level]; }
+
+    // the mixing thread: what the last chunk did
+    void record(uint32_t voices_nearest, uint32_t voices_culled) noexcept
+    {
+        status_.voices_nearest = voices_nearest;
+        status_.voices_culled = voices_culled;
+    }
+
+    // the mixing thread, after each block
+    void update(double mix_seconds, double block_seconds) noexcept;
+
+    // safe from any thread
+    [[nodiscard]] GovernorStatus status() const noexcept { return published_.load(); }
+};
@@ -0,0 +1,63 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// Every buffer of the library comes from a std::pmr::memory_resource, the default one (the heap) unless one is given.
+// With a std::pmr::monotonic_buffer_resource over a static region, upstream std::pmr::null_memory_resource(),
+// nothing touches the heap; an arena per stream makes tearing it down a single release().
+
+[[nodiscard]] inline std::pmr::memory_resource* orDefault(std::pmr::memory_resource* memory) noexcept
+{
+    return memory ? memory : std::pmr::get_default_resource();
+}
+
+template <typename T>
+class ResourceDelete final
+{
+    std::pmr::memory_resource* memory_ = nullptr;
+    size_t count_ = 0;
+    size_t alignment_ = alignof(T);
+
+public:
+    ResourceDelete() noexcept = default;
+
+    ResourceDelete(std::pmr::memory_resource* memory, size_t count, size_t alignment) noexcept :
+        memory_{memory},
+        count_{count},
+        alignment_{alignment}
+    {
+    }
+
+    void operator()(T* p) const noexcept
+    {
+        std::destroy_n(p, count_);
+        memory_->deallocate(p, count_ * sizeof(T), alignment_);
+    }
+};
+
+template <typename T>
+using ResourceArray = std::unique_ptr<T[], ResourceDelete<T>>;
+
+// default-initialized, as std::make_unique_for_overwrite
+template <typename T>
+[[nodiscard]] ResourceArray<T> makeResourceArray(std::pmr::memory_resource* memory, size_t count,
+                                                 size_t alignment = alignof(T))
+{
+    memory = orDefault(memory);
+    T* p = static_cast<T*>(memory->allocate(count * sizeof(T), alignment));
+    std::uninitialized_default_construct_n(p, count);
+    return ResourceArray<T>{p, ResourceDelete<T>{memory, count, alignment}};
+}
+
+// the same, with shared ownership (the control block comes from memory too)
+template <typename T>
+[[nodiscard]] std::shared_ptr<T[]> makeSharedResourceArray(std::pmr::memory_resource* memory, size_t count)
+{
+    return std::allocate_shared_for_overwrite<T[]>(std::pmr::polymorphic_allocator<T>{orDefault(memory)}, count);
+}
@@ -12,23 +12,30 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <optional>
 
+#include "governor.h"
 #include "mixer_channel.h"
 #include "playback.h"
 #include "position.h"
+#include "resampler.h"
 #include "sample.h"
+#include "seqlock.h"
+#include "stats.h"
 
 struct TimeInfo final
 {
     Position position{};
-    uint32_t samples{};
+    uint64_t samples{};
 };
 
 class Mixer final
 {
 public:
-    using TickFunction = Position(void* context);
+    // frame is the first frame mixed with the tick, on the same clock as TimeInfo::samples
+    using TickFunction = Position(void* context, uint64_t frame);
 
 private:
     // mixing info
@@ -36,10 +43,34 @@ private:
     void* tick_context_;
 
     std::unique_ptr<IPlaybackDriver> driver_;
-    std::unique_ptr<TimeInfo[]> time_info_;
+    unsigned int mix_rate_; // the channels are mixed at this rate...
+    std::optional<Resampler> resampler_; // ...and resampled to the driver's, if it differs
+
+    // every tick mixed, with the frame it starts at, for the readers to look the played one up
+    struct TickRecord final
+    {
+        uint64_t index;
+        uint64_t frame;
+        Position position;
+    };
+    ResourceArray<SeqLock<TickRecord>> ticks_;
+    uint64_t tick_mask_;
+    std::atomic<uint64_t> ticks_published_;
+    uint64_t frames_mixed_; // at mix_rate_
 
     float volume_filter_k_;
-    std::unique_ptr<float[]> mix_buffer_; // mix output buffer (stereo 32bit float)
+    float volume_scale_; // a power of two, so that scaling is lossless
+    float silence_; // voices under this volume add less than half a 16 bit step: they become virtual
+    // song channels (bits 0-31, for mixer channels i and i + 32) muted, and soloed: when any is, only those play
+    std::atomic<uint32_t> muted_{0};
+    std::atomic<uint32_t> soloed_{0};
+    Governor governor_;
+    MixerStatsCounters stats_;
+    ResourceArray<float> mix_buffer_; // mix (or resampler) output buffer (stereo 32bit float)
+
+    // voices are mixed chunk by chunk into planar left/right halves, which stay in L1
+    static constexpr uint32_t chunk_frames = 256;
+    ResourceArray<float> chunk_;
 
     //= VARIABLE EXTERNS ==========================================================================
     MixerChannel channel_[64]; // channel pool
@@ -47,13 +78,13 @@ private:
     // thread control variables
     uint32_t mixer_samples_left_;
     unsigned int bpm_;
-    TimeInfo last_mixed_time_info_;
 
-    const TimeInfo& fill(short target[]) noexcept;
+    void mix(float target[], uint32_t frames) noexcept;
+    void fill(void* target, uint32_t frames) noexcept;
 
 public:
     explicit Mixer(std::unique_ptr<IPlaybackDriver> driver, TickFunction tick_function, void* tick_context,
-                   uint16_t bpm, float volume_filter_time_constant = 0.003f);
+                   uint16_t bpm, float volume_filter_time_constant = 0.003f, unsigned int mix_rate = 0);
 
     [[nodiscard]] MixerChannel& getChannel(int index)
     {
@@ -69,8 +100,42 @@ public:
 
     void setBPM(unsigned int bpm) noexcept { bpm_ = bpm; }
 
+    // Muted channels, and the others while any is soloed, ramp out and keep playing virtually, at no mixing cost.
+    // Safe from any thread, and kept across reset().
+    void setMuted(int channel, bool muted) noexcept
+    {
+        assert(channel >= 0 && channel < 32);
+        muted ? muted_.fetch_or(1u << channel, std::memory_order_relaxed)
+              : muted_.fetch_and(~(1u << channel), std::memory_order_relaxed);
+    }
+
+    void setSoloed(int channel, bool soloed) noexcept
+    {
+        assert(channel >= 0 && channel < 32);
+        soloed ? soloed_.fetch_or(1u << channel, std::memory_order_relaxed)
+               : soloed_.fetch_and(~(1u << channel), std::memory_order_relaxed);
+    }
+
+    // the governor trades quality for time when mixing gets close to the deadline (on by default); safe from any
+    // thread, as is reading what it's doing
+    void setGovernorEnabled(bool enabled) noexcept { governor_.setEnabled(enabled); }
+    [[nodiscard]] GovernorStatus getGovernorStatus() const noexcept { return governor_.status(); }
+
+    // safe from any thread, cheap enough to poll
+    [[nodiscard]] MixerStats getStats() const;
+
+    // silences all channels and rewinds the tick clock (the mixer must be stopped)
+    void reset(uint16_t bpm) noexcept;
+
+    // the rate the channels are mixed at, which the output is resampled from
     [[nodiscard]] unsigned int getMixRate() const noexcept;
+    // the driver's rate, which event frames and getFramesPlayed() count in
+    [[nodiscard]] unsigned int getOutputRate() const noexcept;
+    // channel volumes are multiplied by this, to mix straight in the output's range
+    [[nodiscard]] float getVolumeScale() const noexcept { return volume_scale_; }
+    // position of the sample being heard right now, lock-free and safe to call from any thread
     [[nodiscard]] TimeInfo getTimeInfo() const;
+    [[nodiscard]] uint64_t getFramesPlayed() const;
 
     void start();
     void stop();
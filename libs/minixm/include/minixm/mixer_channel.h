@@ -16,6 +16,14 @@
 
 #include "sample.h"
 
+// how the mixer has a voice mixed
+enum class VoiceMode : uint8_t
+{
+    Full,
+    Nearest, // without interpolation, cheaper
+    Muted, // ramped out, then virtual
+};
+
 struct MixerChannel final
 {
     unsigned int sample_offset; // sample offset (sample starts playing from here).
@@ -32,5 +40,13 @@ struct MixerChannel final
     float filtered_left_volume;
     float filtered_right_volume;
 
-    void mix(float* mixptr, uint32_t len, float filter_k);
+    uint32_t loop_wraps; // times the loop wrapped, for the mixer's statistics, which take and clear it
+
+    // Adds len frames to the planar left/right buffers, or overwrites them (silence included) when overwrite is set.
+    // Returns whether anything was written. Voices whose volumes are all under silence, and muted ones once they
+    // ramped down, are virtual: they write nothing and only advance, without reading the sample.
+    bool mix(float* left, float* right, uint32_t len, float filter_k, float silence, VoiceMode mode, bool overwrite);
+
+    // moves len frames on, wrapping around the loop or ending the sample as mixing would
+    void advance(uint32_t len) noexcept;
 };
@@ -12,36 +12,100 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 
 #include "channel.h"
 #include "instrument.h"
+#include "memory.h"
 #include "pattern.h"
 #include "system_file.h"
 
 #include <xmformat/file_header.h>
 
+class SampleResidency;
+class SampleStore;
+
+// How far a module load got, in patterns and instruments (samples included), shared with the thread loading it.
+// A cancelled load stops at the next pattern or instrument and leaves the module empty.
+struct LoadProgress final
+{
+    std::atomic<uint32_t> done{0};
+    std::atomic<uint32_t> total{0};
+    std::atomic<bool> cancel_requested{false};
+
+    void cancel() noexcept { cancel_requested.store(true, std::memory_order_relaxed); }
+    [[nodiscard]] bool cancelled() const noexcept { return cancel_requested.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] float fraction() const noexcept
+    {
+        const uint32_t all = total.load(std::memory_order_relaxed);
+        return all ? static_cast<float>(done.load(std::memory_order_relaxed)) / static_cast<float>(all) : 0.f;
+    }
+};
+
+struct ModuleLoadOptions final
+{
+    bool mip_maps = false; // build Sample::mip_buff, so that high notes don't alias
+    bool adpcm = false; // keep samples as 4 bit ADPCM (SampleStorage::ADPCM), lossy
+    SampleStore* store = nullptr; // shares the frames of identical samples, must outlive the module
+    SampleResidency* residency = nullptr; // keeps the sample frames within a memory budget, must outlive the module
+    const char* name = nullptr; // what FileAccess::open reopens the module by, to reload frames for residency
+    std::pmr::memory_resource* memory = nullptr; // where sample frames are allocated, must outlive the module
+    LoadProgress* progress = nullptr; // reports progress and takes cancellation, must outlive the load
+};
+
 struct Module final
 {
-    XMHeader header_;
-    Pattern pattern_[256]; // patterns array for this song
-    Instrument instrument_[128]; // instrument array for this song (not used in MOD/S3M)
+    XMHeader header_{};
+    // header_.patterns_count patterns (256 at most), never written once loaded: modules mapped from the module cache
+    // share them
+    std::shared_ptr<const Pattern[]> pattern_;
+    Instrument instrument_[128]{}; // instrument array for this song, those the file has no room for left empty
+
+    SampleResidency* residency_ = nullptr;
 
     using SampleLoadFunction = void(int16_t*, size_t, int, int);
 
     Module(const minifmod::FileAccess& fileAccess, void* fp,
-           SampleLoadFunction* sample_load_callback);
+           SampleLoadFunction* sample_load_callback, const ModuleLoadOptions& options = {});
+    // an empty module, for whoever builds one other than from a file (the module cache client)
+    Module() noexcept = default;
+    Module(const Module&) = delete;
+    Module& operator =(const Module&) = delete;
+    ~Module();
+
+    // new (memory) Module{...} allocates the module itself from memory, plain new from the default resource;
+    // either way std::unique_ptr<Module> deletes it
+    static void* operator new(size_t size, std::pmr::memory_resource* memory);
+    static void* operator new(size_t size);
+    static void operator delete(void* p) noexcept;
+    static void operator delete(void* p, std::pmr::memory_resource* memory) noexcept;
+
+    // reads the frames of sample, whose header is loaded, from where fp is, and lays them out for the mixer;
+    // false, with no frames kept, if the file ends before them
+    static bool loadSample(Sample& sample, const minifmod::FileAccess& fileAccess, void* fp,
+                           const ModuleLoadOptions& options);
+
+    // orders may name patterns the file doesn't have: those play as empty 64 row patterns
+    [[nodiscard]] const Pattern& getPattern(int pattern) const noexcept
+    {
+        static const Pattern empty;
+        return pattern < header_.patterns_count && pattern_ ? pattern_[pattern] : empty;
+    }
 
+    // patterns may name instruments the file doesn't have (a channel starts on instrument 0 even without any):
+    // those are the empty ones past instruments_count, and play nothing
     [[nodiscard]] const Instrument& getInstrument(int instrument) const
     {
-        assert(instrument >= 0 && instrument < header_.instruments_count);
+        assert(instrument >= 0 && instrument < 128);
         return instrument_[instrument];
     }
 
     [[nodiscard]] Instrument& getInstrument(int instrument)
     {
-        assert(instrument >= 0 && instrument < header_.instruments_count);
+        assert(instrument >= 0 && instrument < 128);
         return instrument_[instrument];
     }
 };
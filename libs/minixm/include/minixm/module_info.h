@@ -0,0 +1,33 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "system_file.h"
+
+// What a music library lists about a module, without loading it
+struct ModuleInfo final
+{
+    std::string name;
+    std::string tracker;
+    int channels = 0;
+    int song_length = 0; // orders
+    int patterns = 0;
+    int instruments = 0;
+    int tempo = 0; // default ticks per row
+    int bpm = 0;
+    bool linear_frequencies = false;
+    uint32_t rows = 0; // of all patterns
+    uint32_t samples = 0; // with data
+    uint64_t sample_bytes = 0; // as stored in the file
+    std::vector<std::string> instrument_names;
+};
+
+// Reads the module's header, pattern headers and instrument and sample headers from where fp is, seeking past
+// pattern and sample data. False if it isn't an XM file or it ends early.
+bool scanModule(const minifmod::FileAccess& fileAccess, void* fp, ModuleInfo& info);
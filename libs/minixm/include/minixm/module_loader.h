@@ -0,0 +1,55 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "module.h"
+#include "system_file.h"
+
+// Loads modules in the background. One thread reads the files, a chunk at a time from each load in turn, while
+// the decoding threads unpack patterns and samples out of what has arrived so far: waiting on I/O overlaps with
+// decoding, and many loads share a few threads.
+class ModuleLoader final
+{
+public:
+    // bytes read from a file before moving on to the next load
+    static constexpr size_t chunk_bytes = 64 * 1024;
+
+private:
+    struct Job;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::shared_ptr<Job>> reads_; // loads with more to read, in turn
+    std::deque<std::shared_ptr<Job>> decodes_; // loads waiting for a decoding thread
+    std::vector<std::shared_ptr<Job>> active_; // loads being decoded
+    bool running_ = true;
+    std::thread reader_;
+    std::vector<std::thread> decoders_;
+
+    void read();
+    void decode();
+
+public:
+    explicit ModuleLoader(unsigned int decode_threads = 2);
+    ModuleLoader(const ModuleLoader&) = delete;
+    ModuleLoader& operator =(const ModuleLoader&) = delete;
+    // cancels the loads still going, their futures get null
+    ~ModuleLoader();
+
+    // Starts loading the module fileAccess opens by name; the future gets it, or null if the file couldn't be
+    // opened or options.progress was cancelled, or throws what the load threw (std::bad_alloc out of an exhausted
+    // options.memory). fileAccess's user must outlive the load (and the module, with options.residency), the
+    // module comes from options.memory.
+    [[nodiscard]] std::future<std::unique_ptr<Module>> load(const minifmod::FileAccess& fileAccess, const char* name,
+                                                            const ModuleLoadOptions& options = {});
+};
@@ -16,14 +16,36 @@
 #include <cstdint>
 #include <memory>
 
+#include "memory.h"
+
+// what the driver wants in the buffers it asks the mixer to fill (always interleaved stereo)
+enum class SampleFormat : uint8_t
+{
+    S16,
+    S32,
+    F32, // -1..1, straight from the mixer
+};
+
+[[nodiscard]] constexpr uint32_t bytesPerSample(SampleFormat format) noexcept
+{
+    return format == SampleFormat::S16 ? 2 : 4;
+}
+
 class IPlaybackDriver
 {
     uint32_t mix_rate_; // mixing rate in hz.
     uint32_t block_size_; // LATENCY ms worth of samples
     uint32_t total_blocks_;
     uint32_t buffer_size_; // size of 1 'latency' ms buffer in bytes
+    SampleFormat sample_format_ = SampleFormat::S16;
+    std::pmr::memory_resource* memory_ = nullptr;
 protected:
-    IPlaybackDriver(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency);
+    // memory is where the driver's buffers come from, and the mixer's too (null: the default resource)
+    IPlaybackDriver(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency,
+                    std::pmr::memory_resource* memory = nullptr);
+
+    // for drivers that negotiate with the device, before start()
+    void setSampleFormat(SampleFormat format) noexcept { sample_format_ = format; }
 
 public:
     IPlaybackDriver() = default;
@@ -37,11 +59,19 @@ public:
     [[nodiscard]] uint32_t block_size() const noexcept { return block_size_; }
     [[nodiscard]] uint32_t mix_rate() const noexcept { return mix_rate_; }
     [[nodiscard]] uint32_t buffer_size() const noexcept { return buffer_size_; }
+    [[nodiscard]] SampleFormat sample_format() const noexcept { return sample_format_; }
+    [[nodiscard]] uint32_t frame_bytes() const noexcept { return bytesPerSample(sample_format_) * 2; }
+    [[nodiscard]] std::pmr::memory_resource* memory_resource() const noexcept { return orDefault(memory_); }
 
-    using FillFunction = void(void* arg, size_t block, short data[]) noexcept;
+    // fills data with frames stereo frames (at most block_size()) in sample_format(), all belonging to the given block
+    using FillFunction = void(void* arg, size_t block, void* data, uint32_t frames) noexcept;
 
     virtual void start(FillFunction* fill, void* arg) = 0;
     virtual void stop() = 0;
 
-    [[nodiscard]] virtual size_t current_block_played() const = 0;
+    // frames heard so far since start(), as precisely as the device can tell (callable from any thread)
+    [[nodiscard]] virtual uint64_t frames_played() const = 0;
+
+    // times the device ran out of frames to play since start() (callable from any thread), 0 if it can't tell
+    [[nodiscard]] virtual uint64_t underruns() const { return 0; }
 };
@@ -14,9 +14,11 @@
 
 #include <algorithm>
 
+#include "event_stream.h"
 #include "module.h"
 #include "mixer.h"
 #include "position.h"
+#include "residency.h"
 #include "xmeffects.h"
 
 // Song type - contains info on song
@@ -26,6 +28,7 @@ private:
     Channel channels_[32]{}; // channel array for this song
 
     std::unique_ptr<Module> module_;
+    EventStream events_; // outlives the mixer, whose thread feeds it
     Mixer mixer_;
     int global_volume_; // global mod volume
     int tick_; // current mod tick
@@ -33,6 +36,8 @@ private:
     int pattern_delay_; // pattern delay counter
     Position current_;
     Position next_;
+    uint64_t tick_frame_; // first frame of the tick being played
+    bool acquired_ = false; // the module's samples are pinned in its SampleResidency
 #ifdef FMUSIC_XM_GLOBALVOLSLIDE_ACTIVE
     int global_volume_slide_ = 0; // global mod volume
 #endif
@@ -40,13 +45,39 @@ private:
     void updateNote();
     void updateTick();
 
-    Position tick();
+    Position tick(uint64_t frame);
+
+    void pushEvent(PlayerEvent::Type type, int channel = 0, int param = 0) noexcept
+    {
+        if (events_.wants(type))
+        {
+            events_.push({type, tick_, current_, channel, param, tick_frame_});
+        }
+    }
 
 public:
-    PlayerState(std::unique_ptr<IPlaybackDriver> driver, std::unique_ptr<Module> module);
+    // mix_rate is the rate channels are mixed at, resampled to the driver's (0: the driver's own)
+    PlayerState(std::unique_ptr<IPlaybackDriver> driver, std::unique_ptr<Module> module, unsigned int mix_rate = 0);
+    ~PlayerState()
+    {
+        events_.stop();
+    }
+
+    // events of the types in mask (PlayerEvent::Type bits) go to callback, on a thread of its own,
+    // as they are heard (the player must be stopped)
+    void setEventCallback(EventStream::Callback* callback, void* context, uint32_t mask) noexcept
+    {
+        events_.setCallback(callback, context, mask);
+    }
 
     void start()
     {
+        if (module_->residency_ && !acquired_)
+        {
+            module_->residency_->acquire(*module_);
+            acquired_ = true;
+        }
+        events_.start(mixer_);
         mixer_.start();
     }
 
@@ -55,12 +86,50 @@ public:
         mixer_.setBPM(bpm);
     }
 
+    // muted channels (0-31), and the others while any is soloed, cost nothing to mix; safe while playing
+    void setChannelMuted(int channel, bool muted) noexcept
+    {
+        mixer_.setMuted(channel, muted);
+    }
+
+    void setChannelSoloed(int channel, bool soloed) noexcept
+    {
+        mixer_.setSoloed(channel, soloed);
+    }
+
+    // see Governor: on by default, off keeps full quality whatever the load
+    void setGovernorEnabled(bool enabled) noexcept
+    {
+        mixer_.setGovernorEnabled(enabled);
+    }
+
+    [[nodiscard]] GovernorStatus getGovernorStatus() const noexcept
+    {
+        return mixer_.getGovernorStatus();
+    }
+
+    // CPU usage, fill times, voices and underruns, safe from any thread
+    [[nodiscard]] MixerStats getStats() const
+    {
+        return mixer_.getStats();
+    }
+
     std::unique_ptr<Module> stop()
     {
         mixer_.stop();
+        events_.stop();
+        if (acquired_)
+        {
+            module_->residency_->release(*module_);
+            acquired_ = false;
+        }
         return std::move(module_);
     }
 
+    // Rewinds to the start of a new module, reusing the mixer and its buffers (the player must be stopped).
+    // Returns the previous module, so that its storage can be recycled as well.
+    std::unique_ptr<Module> reset(std::unique_ptr<Module> module);
+
     [[nodiscard]] TimeInfo getTimeInfo() const
     {
         return mixer_.getTimeInfo();
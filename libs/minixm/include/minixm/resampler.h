@@ -0,0 +1,44 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "memory.h"
+
+// Polyphase windowed-sinc resampler for interleaved stereo float, from the mixer's rate to the device's.
+// The ratio is kept exact as a fraction, with up to max_phases filter phases.
+class Resampler final
+{
+public:
+    // mixes frames (interleaved stereo) at the input rate into data
+    using PullFunction = void(void* context, float data[], uint32_t frames) noexcept;
+
+    static constexpr uint32_t taps = 16;
+    static constexpr uint32_t max_phases = 1024;
+
+private:
+    uint32_t step_; // input rate, reduced
+    uint32_t phases_; // output rate, reduced: phase_ goes round in steps of step_
+    uint32_t table_phases_; // min(phases_, max_phases)
+    ResourceArray<float> table_; // table_phases_ * taps pairs (each tap twice, for L and R)
+
+    uint32_t max_pull_;
+    uint32_t capacity_; // frames in input_
+    ResourceArray<float> input_;
+    uint32_t count_; // frames buffered in input_
+    uint32_t index_; // first frame under the filter for the next output
+    uint32_t phase_;
+
+public:
+    // max_pull is the most frames the pull function will be asked for in one go
+    Resampler(uint32_t input_rate, uint32_t output_rate, uint32_t max_pull, std::pmr::memory_resource* memory = nullptr);
+
+    void reset() noexcept;
+
+    // makes frames output frames, pulling input as needed
+    void process(float output[], uint32_t frames, PullFunction* pull, void* context) noexcept;
+};
@@ -0,0 +1,99 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "module.h"
+#include "system_file.h"
+
+// Keeps the sample frames of many loaded modules within a memory budget.
+// Modules that aren't playing give up their frames, least recently played first, and get them back from their
+// file when they play again: the first orders before starting, the rest on a thread of its own, in the order the
+// song needs them. Until a sample is back, its notes are silent. Samples filled by the load callback never leave.
+// Frames shared through a SampleStore count once, and only leave together, when no module using them plays.
+class SampleResidency final
+{
+public:
+    // orders whose samples are loaded before a song starts
+    static constexpr int ahead_orders = 2;
+
+private:
+    enum class State : uint8_t
+    {
+        Resident,
+        Evicted,
+        Queued,
+        Loading,
+    };
+
+    struct SampleEntry final
+    {
+        Sample* sample;
+        int first_order; // the first order playing it, a hint of how soon it is needed
+        size_t bytes; // while resident
+        const void* frames; // while resident, what the bytes are charged to
+        State state;
+    };
+
+    struct ModuleEntry final
+    {
+        Module* module;
+        minifmod::FileAccess file_access;
+        std::string name;
+        ModuleLoadOptions options;
+        std::vector<SampleEntry> samples;
+        int pins = 0;
+        uint64_t last_used = 0;
+    };
+
+    size_t budget_;
+    size_t resident_bytes_ = 0;
+    std::unordered_map<const void*, uint32_t> charged_; // resident frames, and how many samples here use each
+    uint64_t clock_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::unique_ptr<ModuleEntry>> modules_;
+    std::deque<std::pair<ModuleEntry*, size_t>> queue_;
+    bool running_ = true;
+    std::thread thread_;
+
+    ModuleEntry* find(const Module& module) noexcept;
+    void charge(SampleEntry& sample);
+    void discharge(SampleEntry& sample) noexcept;
+    bool evictable(const SampleEntry& sample) const noexcept;
+    void evict(SampleEntry& sample) noexcept;
+    bool load(std::unique_lock<std::mutex>& lock, ModuleEntry& entry, SampleEntry& sample);
+    void enforceBudget() noexcept;
+    void run();
+
+public:
+    explicit SampleResidency(size_t budget_bytes);
+    SampleResidency(const SampleResidency&) = delete;
+    SampleResidency& operator =(const SampleResidency&) = delete;
+    ~SampleResidency();
+
+    // called by Module, with its samples loaded and name being what fileAccess opens it by; fileAccess is kept,
+    // its user must outlive the module
+    void add(Module& module, const minifmod::FileAccess& fileAccess, const char* name,
+             const ModuleLoadOptions& options);
+    void remove(const Module& module);
+
+    // Pins the module's samples while it plays (PlayerState::start and stop do this): none of them is evicted,
+    // and missing ones are brought back. Returns false if some sample of the first orders couldn't be reloaded.
+    bool acquire(const Module& module);
+    void release(const Module& module);
+
+    [[nodiscard]] size_t residentBytes();
+};
@@ -12,14 +12,97 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 
+#include "adpcm.h"
+
 #include <xmformat/sample_header.h>
 
+// how the frames of a sample are kept in memory
+enum class SampleStorage : uint8_t
+{
+    PCM16, // buff
+    PCM8, // buff8, as in 8 bit files: half the memory, same sound
+    ADPCM, // adpcm (see adpcm.h): a quarter of the memory, lossy
+};
+
 // Sample type - contains info on sample
 struct Sample final
 {
+    // loops shorter than this are unrolled, so that the mixer rarely has to wrap
+    static constexpr uint32_t min_mix_loop_length = 512;
+    static constexpr uint32_t max_mip_levels = 4;
+
     XMSampleHeader header;
-    std::unique_ptr<int16_t[]> buff; // pointer to sound data
+    std::atomic<bool> resident{true}; // the frames are there: the mixer skips the sample otherwise
+    long file_offset = -1; // where the frames start in the module file, -1 if they came from the load callback
+    SampleStorage storage = SampleStorage::PCM16;
+    // the frames are shared between identical samples when loaded through a SampleStore, and never written after
+    std::shared_ptr<int16_t[]> buff; // pointer to sound data
+    std::shared_ptr<int8_t[]> buff8; // the frames of 8 bit samples, scaled by 1/256
+    std::shared_ptr<uint8_t[]> adpcm; // ADPCM blocks, for frames up to the end of the loop and its guard
+
+    // How the mixer plays the frames, whatever the storage: loops only go forward (bidi loops are stored mirrored)
+    // and are unrolled to at least min_mix_loop_length. Up to loop end, the frames are the sample as in the file,
+    // so positions mean the same thing.
+    uint32_t mix_loop_start = 0;
+    uint32_t mix_loop_length = 0; // the whole sample if not looping
+    bool mix_looped = false;
+
+    // The frames band-limited and decimated by 2, 4, 8 and 16, for fast playback. Empty unless asked for at load time.
+    // Frame i of level k is centered on frame i << (k + 1), and continues the loop past its end as the frames do.
+    std::shared_ptr<int16_t[]> mip_buff[max_mip_levels];
+
+    // frames stored, the loop and the guard after it included
+    [[nodiscard]] uint32_t storedFrames() const noexcept { return mix_loop_start + mix_loop_length + 8; }
+
+    [[nodiscard]] static uint32_t mipFrames(uint32_t frames, uint32_t level) noexcept
+    {
+        const uint32_t factor = 2u << level;
+        return (frames - 8 + factor - 1) / factor + 8;
+    }
+
+    // the stored frames in their storage, null if there are none
+    [[nodiscard]] const void* frameData() const noexcept
+    {
+        switch (storage)
+        {
+        case SampleStorage::PCM8:
+            return buff8.get();
+        case SampleStorage::ADPCM:
+            return adpcm.get();
+        case SampleStorage::PCM16:
+        default:
+            return buff.get();
+        }
+    }
+
+    // bytes at frameData()
+    [[nodiscard]] size_t storedBytes() const noexcept
+    {
+        const uint32_t frames = storedFrames();
+        switch (storage)
+        {
+        case SampleStorage::PCM8:
+            return frames;
+        case SampleStorage::ADPCM:
+            return adpcm::blockCount(frames) * adpcm::block_bytes;
+        case SampleStorage::PCM16:
+        default:
+            return frames * sizeof(int16_t);
+        }
+    }
+
+    // memory taken by the frames, mip maps included
+    [[nodiscard]] size_t frameBytes() const noexcept
+    {
+        size_t bytes = storedBytes();
+        for (uint32_t level = 0; level < max_mip_levels && mip_buff[level]; ++level)
+        {
+            bytes += mipFrames(storedFrames(), level) * sizeof(int16_t);
+        }
+        return bytes;
+    }
 };
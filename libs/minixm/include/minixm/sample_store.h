@@ -0,0 +1,42 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "sample.h"
+
+// Shares the frames of identical samples, within a module and across the modules loaded through it.
+// Samples are matched by a hash of their frames and loop, then compared in full. The store only keeps weak
+// references: frames go away with the last sample using them.
+class SampleStore final
+{
+    struct Entry final
+    {
+        SampleStorage storage;
+        uint32_t mix_loop_start;
+        uint32_t mix_loop_length;
+        bool mix_looped;
+        std::weak_ptr<int16_t[]> buff;
+        std::weak_ptr<int8_t[]> buff8;
+        std::weak_ptr<uint8_t[]> adpcm;
+        std::weak_ptr<int16_t[]> mip_buff[Sample::max_mip_levels];
+    };
+
+    std::mutex mutex_;
+    std::unordered_multimap<uint64_t, Entry> entries_;
+    uint64_t shared_bytes_ = 0;
+
+public:
+    // Makes sample, laid out for the mixer, use the frames of an identical one already in the store, or adds it.
+    // Thread safe, for loading modules in parallel.
+    void share(Sample& sample);
+
+    // memory that loading through the store saved, so far
+    [[nodiscard]] uint64_t sharedBytes();
+};
@@ -0,0 +1,70 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single writer, many readers. The writer never waits, readers retry while a store is in flight.
+// The value is kept in atomic words, so that the torn reads a retry throws away are not data races.
+template <typename T>
+class SeqLock final
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    static constexpr size_t word_count = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> sequence_{0};
+    std::atomic<uint64_t> words_[word_count]{};
+
+public:
+    void store(const T& value) noexcept
+    {
+        uint64_t words[word_count]{};
+        memcpy(words, &value, sizeof(T));
+
+        const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < word_count; ++i)
+        {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    // returns false if a store was in flight, leaving value unspecified
+    [[nodiscard]] bool tryLoad(T& value) const noexcept
+    {
+        const uint32_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            return false;
+        }
+        uint64_t words[word_count];
+        for (size_t i = 0; i < word_count; ++i)
+        {
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) != before)
+        {
+            return false;
+        }
+        memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+    [[nodiscard]] T load() const noexcept
+    {
+        T value;
+        while (!tryLoad(value))
+        {
+        }
+        return value;
+    }
+};
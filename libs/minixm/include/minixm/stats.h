@@ -0,0 +1,104 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// What the mixer has been doing since it was built, for monitoring. Times are wall clock, on the mixing thread.
+struct MixerStats final
+{
+    static constexpr int fill_buckets = 16;
+
+    uint64_t blocks; // filled
+    uint64_t frames; // in them, at the driver's rate
+    uint64_t audio_ns; // how long they play for
+    uint64_t fill_ns; // how long they took to fill...
+    uint64_t tick_ns; // ...of which in the player's ticks, the rest mixing, resampling and converting
+    // fills by duration: bucket 0 under 1 microsecond, bucket i from 2^(i-1) to 2^i, the last one anything longer
+    uint64_t fill_histogram[fill_buckets];
+    uint64_t loop_wraps; // times voices went around their loops
+    uint32_t active_voices; // as of the last chunk mixed: voices playing...
+    uint32_t virtual_voices; // ...of which virtual (inaudible or muted)
+    uint32_t peak_voices; // the most voices ever playing at once
+    uint64_t underruns; // as the driver counts them, 0 if it can't tell
+
+    // time taken to fill blocks over the time they play for
+    [[nodiscard]] double cpuUsage() const noexcept
+    {
+        return audio_ns ? static_cast<double>(fill_ns) / static_cast<double>(audio_ns) : 0.0;
+    }
+};
+
+// The counters behind MixerStats. Only the mixing thread writes them, with relaxed loads and stores rather than
+// read-modify-writes, so keeping them costs a few plain stores a chunk; any thread can take a snapshot.
+class MixerStatsCounters final
+{
+    std::atomic<uint64_t> blocks_{0};
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> audio_ns_{0};
+    std::atomic<uint64_t> fill_ns_{0};
+    std::atomic<uint64_t> tick_ns_{0};
+    std::atomic<uint64_t> fill_histogram_[MixerStats::fill_buckets]{};
+    std::atomic<uint64_t> loop_wraps_{0};
+    std::atomic<uint32_t> active_voices_{0};
+    std::atomic<uint32_t> virtual_voices_{0};
+    std::atomic<uint32_t> peak_voices_{0};
+
+    template <typename T>
+    static void add(std::atomic<T>& counter, T value) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+public:
+    void recordFill(uint32_t frames, uint64_t audio_ns, uint64_t fill_ns) noexcept
+    {
+        add(blocks_, uint64_t{1});
+        add(frames_, uint64_t{frames});
+        add(audio_ns_, audio_ns);
+        add(fill_ns_, fill_ns);
+        const int bucket = std::min(static_cast<int>(std::bit_width(fill_ns / 1000)), MixerStats::fill_buckets - 1);
+        add(fill_histogram_[bucket], uint64_t{1});
+    }
+
+    void recordTick(uint64_t ns) noexcept { add(tick_ns_, ns); }
+
+    void recordChunk(uint32_t active_voices, uint32_t virtual_voices, uint32_t loop_wraps) noexcept
+    {
+        active_voices_.store(active_voices, std::memory_order_relaxed);
+        virtual_voices_.store(virtual_voices, std::memory_order_relaxed);
+        if (active_voices > peak_voices_.load(std::memory_order_relaxed))
+        {
+            peak_voices_.store(active_voices, std::memory_order_relaxed);
+        }
+        if (loop_wraps)
+        {
+            add(loop_wraps_, uint64_t{loop_wraps});
+        }
+    }
+
+    // counters may be a block apart from each other, underruns are left to the caller
+    [[nodiscard]] MixerStats snapshot() const noexcept
+    {
+        MixerStats stats{};
+        stats.blocks = blocks_.load(std::memory_order_relaxed);
+        stats.frames = frames_.load(std::memory_order_relaxed);
+        stats.audio_ns = audio_ns_.load(std::memory_order_relaxed);
+        stats.fill_ns = fill_ns_.load(std::memory_order_relaxed);
+        stats.tick_ns = tick_ns_.load(std::memory_order_relaxed);
+        for (int i = 0; i < MixerStats::fill_buckets; ++i)
+        {
+            stats.fill_histogram[i] = fill_histogram_[i].load(std::memory_order_relaxed);
+        }
+        stats.loop_wraps = loop_wraps_.load(std::memory_order_relaxed);
+        stats.active_voices = active_voices_.load(std::memory_order_relaxed);
+        stats.virtual_voices = virtual_voices_.load(std::memory_order_relaxed);
+        stats.peak_voices = peak_voices_.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
@@ -12,22 +12,49 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdio>
+
 namespace minifmod
 {
-    using FFileOpen = void*(const char* name);
-    using FFileClose = void(void* handle);
-    using FFileRead = size_t(void* buffer, size_t count, void* handle);
-    using FFileSeek = void(void* handle, long pos, int mode);
-    using FFileTell = long(void* handle);
+    // each callback gets the user pointer of the FileAccess it was called through
+    using FFileOpen = void*(void* user, const char* name);
+    using FFileClose = void(void* user, void* handle);
+    using FFileRead = size_t(void* user, void* buffer, size_t count, void* handle);
+    using FFileSeek = void(void* user, void* handle, long pos, int mode);
+    using FFileTell = long(void* user, void* handle);
 
+    // The I/O context a module is loaded through: callbacks, and the archive, memory block or whatever else they
+    // read from as user. Each load takes its own, so modules load concurrently from different sources.
     struct FileAccess
     {
-        FFileOpen* open;
-        FFileClose* close;
-        FFileRead* read;
-        FFileSeek* seek;
-        FFileTell* tell;
+        FFileOpen* open_callback;
+        FFileClose* close_callback;
+        FFileRead* read_callback;
+        FFileSeek* seek_callback;
+        FFileTell* tell_callback;
+        void* user = nullptr;
+
+        void* open(const char* name) const { return open_callback(user, name); }
+        void close(void* handle) const { close_callback(user, handle); }
+        size_t read(void* buffer, size_t count, void* handle) const { return read_callback(user, buffer, count, handle); }
+        void seek(void* handle, long pos, int mode) const { seek_callback(user, handle, pos, mode); }
+        long tell(void* handle) const { return tell_callback(user, handle); }
     };
 
-    inline FileAccess file_access;
+    // files on disk, through stdio: names are paths
+    namespace stdio_file
+    {
+        inline void* open(void*, const char* name) { return fopen(name, "rb"); }
+        inline void close(void*, void* handle) { fclose(static_cast<FILE*>(handle)); }
+        inline size_t read(void*, void* buffer, size_t count, void* handle)
+        {
+            return fread(buffer, 1, count, static_cast<FILE*>(handle));
+        }
+        inline void seek(void*, void* handle, long pos, int mode) { fseek(static_cast<FILE*>(handle), pos, mode); }
+        inline long tell(void*, void* handle) { return ftell(static_cast<FILE*>(handle)); }
+    }
+
+    inline constexpr FileAccess stdio_file_access{stdio_file::open, stdio_file::close, stdio_file::read,
+                                                  stdio_file::seek, stdio_file::tell};
 }
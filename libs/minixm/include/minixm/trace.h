@@ -0,0 +1,111 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+// Scoped timing of the audio path, for profiling. Configure with -DMINIXM_TRACE=ON to record it; otherwise the
+// MINIXM_TRACE_SCOPE macros compile to nothing, arguments included.
+//
+//     MINIXM_TRACE_SCOPE("Mixer::fill");
+//     MINIXM_TRACE_SCOPE_ARG("Channel::sendToMixer", "channel", index);
+//     MINIXM_TRACE_SCOPE_ARGS("PlayerState::tick", "order", current_.order, "row", current_.row);
+//
+// Each thread records into a ring of its own, without locks; a TraceExporter drains the rings from a thread of
+// its own into a Chrome trace (chrome://tracing, ui.perfetto.dev). Scopes closed while no exporter runs are dropped.
+
+// where a scope is, and what its arguments are called
+struct TraceSite final
+{
+    const char* name;
+    const char* arg_names[2];
+};
+
+[[nodiscard]] uint64_t traceNow() noexcept;
+void traceRecord(const TraceSite& site, uint64_t start_ns, int32_t arg0, int32_t arg1) noexcept;
+
+class TraceScope final
+{
+    const TraceSite& site_;
+    uint64_t start_;
+    int32_t args_[2];
+
+public:
+    explicit TraceScope(const TraceSite& site, int32_t arg0 = 0, int32_t arg1 = 0) noexcept :
+        site_{site},
+        start_{traceNow()},
+        args_{arg0, arg1}
+    {
+    }
+
+    ~TraceScope() { traceRecord(site_, start_, args_[0], args_[1]); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define MINIXM_TRACE_JOIN2(a, b) a##b
+#define MINIXM_TRACE_JOIN(a, b) MINIXM_TRACE_JOIN2(a, b)
+
+#ifdef MINIXM_TRACE
+#define MINIXM_TRACE_SCOPE(name)                                                                                    \
+    static constexpr TraceSite MINIXM_TRACE_JOIN(trace_site_, __LINE__){name, {nullptr, nullptr}};                  \
+    const TraceScope MINIXM_TRACE_JOIN(trace_scope_, __LINE__){MINIXM_TRACE_JOIN(trace_site_, __LINE__)}
+#define MINIXM_TRACE_SCOPE_ARG(name, name0, arg0)                                                                   \
+    static constexpr TraceSite MINIXM_TRACE_JOIN(trace_site_, __LINE__){name, {name0, nullptr}};                    \
+    const TraceScope MINIXM_TRACE_JOIN(trace_scope_, __LINE__){MINIXM_TRACE_JOIN(trace_site_, __LINE__),            \
+                                                               static_cast<int32_t>(arg0)}
+#define MINIXM_TRACE_SCOPE_ARGS(name, name0, arg0, name1, arg1)                                                     \
+    static constexpr TraceSite MINIXM_TRACE_JOIN(trace_site_, __LINE__){name, {name0, name1}};                      \
+    const TraceScope MINIXM_TRACE_JOIN(trace_scope_, __LINE__){MINIXM_TRACE_JOIN(trace_site_, __LINE__),            \
+                                                               static_cast<int32_t>(arg0), static_cast<int32_t>(arg1)}
+#else
+#define MINIXM_TRACE_SCOPE(name) static_cast<void>(0)
+#define MINIXM_TRACE_SCOPE_ARG(name, name0, arg0) static_cast<void>(0)
+#define MINIXM_TRACE_SCOPE_ARGS(name, name0, arg0, name1, arg1) static_cast<void>(0)
+#endif
+
+// Writes what every thread records, from construction to destruction, to a Chrome trace file. One at a time.
+class TraceExporter final
+{
+public:
+#ifdef MINIXM_TRACE
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false; // the file gets written, but nothing records into it
+#endif
+
+private:
+    FILE* file_ = nullptr;
+    uint64_t start_ns_ = 0;
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+
+    void drain();
+
+public:
+    explicit TraceExporter(const char* path);
+    ~TraceExporter();
+
+    TraceExporter(const TraceExporter&) = delete;
+    TraceExporter& operator=(const TraceExporter&) = delete;
+
+    // false if the file couldn't be created, another exporter is running, or it's been stopped
+    [[nodiscard]] bool open() const noexcept { return file_ != nullptr; }
+    // writes what is left and closes the file, as destroying it does
+    void stop();
+    // events written, and lost to full rings, so far
+    [[nodiscard]] uint64_t written() const noexcept { return written_.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,133 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/adpcm.h>
+
+#include <algorithm>
+
+namespace
+{
+    constexpr int16_t step_table[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+        107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+        876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428,
+        4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+        22385, 24623, 27086, 29794, 32767
+    };
+
+    constexpr int8_t index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+    struct State
+    {
+        int predictor;
+        int index;
+
+        // applies a code, returning the decoded frame
+        int16_t step(uint8_t code) noexcept
+        {
+            const int step = step_table[index];
+            int delta = step >> 3;
+            if (code & 4)
+            {
+                delta += step;
+            }
+            if (code & 2)
+            {
+                delta += step >> 1;
+            }
+            if (code & 1)
+            {
+                delta += step >> 2;
+            }
+            predictor = std::clamp(code & 8 ? predictor - delta : predictor + delta, -32768, 32767);
+            index = std::clamp(index + index_table[code & 7], 0, 88);
+            return static_cast<int16_t>(predictor);
+        }
+
+        [[nodiscard]] uint8_t code(int frame) const noexcept
+        {
+            const int step = step_table[index];
+            int difference = frame - predictor;
+            uint8_t code = 0;
+            if (difference < 0)
+            {
+                code = 8;
+                difference = -difference;
+            }
+            if (difference >= step)
+            {
+                code |= 4;
+                difference -= step;
+            }
+            if (difference >= step >> 1)
+            {
+                code |= 2;
+                difference -= step >> 1;
+            }
+            if (difference >= step >> 2)
+            {
+                code |= 1;
+            }
+            return code;
+        }
+    };
+}
+
+void adpcm::encode(const int16_t frames[], uint32_t frame_count, uint8_t blocks[]) noexcept
+{
+    for (uint32_t first = 0; first < frame_count; first += block_frames, blocks += block_bytes)
+    {
+        int16_t block[block_frames];
+        for (uint32_t i = 0; i < block_frames; ++i)
+        {
+            block[i] = frames[std::min(first + i, frame_count - 1)];
+        }
+
+        // Restart from the exact frame, so that errors never carry over into the next block, and from the step
+        // that encodes this block best: a block is small enough for trying them all to be cheap.
+        const int predictor = first ? frames[first - 1] : 0;
+        int best_index = 0;
+        int64_t best_error = INT64_MAX;
+        for (int index = 0; index < 89; ++index)
+        {
+            State state{predictor, index};
+            int64_t error = 0;
+            for (uint32_t i = 0; i < block_frames && error < best_error; ++i)
+            {
+                const int difference = block[i] - state.step(state.code(block[i]));
+                error += static_cast<int64_t>(difference) * difference;
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                best_index = index;
+            }
+        }
+
+        blocks[0] = static_cast<uint8_t>(predictor & 0xff);
+        blocks[1] = static_cast<uint8_t>(predictor >> 8);
+        blocks[2] = static_cast<uint8_t>(best_index);
+        blocks[3] = 0;
+        State state{predictor, best_index};
+        for (uint32_t i = 0; i < block_frames; i += 2)
+        {
+            const uint8_t code0 = state.code(block[i]);
+            state.step(code0);
+            const uint8_t code1 = state.code(block[i + 1]);
+            state.step(code1);
+            blocks[4 + i / 2] = static_cast<uint8_t>(code0 | code1 << 4);
+        }
+    }
+}
+
+void adpcm::decodeBlock(const uint8_t block[], int16_t frames[block_frames]) noexcept
+{
+    State state{static_cast<int16_t>(block[0] | block[1] << 8), block[2]};
+    for (uint32_t i = 0; i < block_frames; i += 2)
+    {
+        const uint8_t byte = block[4 + i / 2];
+        frames[i] = state.step(byte & 0x0f);
+        frames[i + 1] = state.step(byte >> 4);
+    }
+}
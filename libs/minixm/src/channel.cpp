@@ -14,6 +14,7 @@
 
 #include <algorithm>
 
+#include <minixm/trace.h>
 #include <minixm/xmeffects.h>
 
 namespace
@@ -226,6 +227,7 @@ void Channel::updateVolume() noexcept
 
 void Channel::sendToMixer(Mixer& mixer, const Instrument& instrument, int global_volume, bool linear_frequency) const
 {
+    MINIXM_TRACE_SCOPE_ARG("Channel::sendToMixer", "channel", index);
     MixerChannel& sound_channel = mixer.getChannel(index);
     if (trigger)
     {
@@ -261,7 +263,8 @@ void Channel::sendToMixer(Mixer& mixer, const Instrument& instrument, int global
     }
     constexpr static float norm = 1.0f / 68451041280.0f;
     // 2^27 (volume normalization) * 255.0 (pan scale) (*2 for safety?!?)
-    float high_precision_volume = static_cast<float>((volume + volume_delta) * fade_out_volume * global_volume) * norm;
+    float high_precision_volume = static_cast<float>((volume + volume_delta) * fade_out_volume * global_volume) * norm *
+        mixer.getVolumeScale();
 #ifdef FMUSIC_XM_VOLUMEENVELOPE_ACTIVE
     high_precision_volume *= volume_envelope();
 #endif
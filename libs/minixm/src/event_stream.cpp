@@ -0,0 +1,93 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/event_stream.h>
+
+#include <minixm/mixer.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+EventStream::~EventStream()
+{
+    stop();
+}
+
+void EventStream::setCallback(Callback* callback, void* context, uint32_t mask) noexcept
+{
+    assert(!thread_.joinable());
+    callback_ = callback;
+    context_ = context;
+    mask_ = callback ? mask : 0;
+    if (mask_ && !ring_)
+    {
+        ring_ = makeResourceArray<PlayerEvent>(memory_, capacity);
+    }
+}
+
+void EventStream::push(const PlayerEvent& event) noexcept
+{
+    const uint64_t written = written_.load(std::memory_order_relaxed);
+    if (!running_.load(std::memory_order_relaxed) || written - read_.load(std::memory_order_acquire) >= capacity)
+    {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring_[written % capacity] = event;
+    written_.store(written + 1, std::memory_order_release);
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+}
+
+void EventStream::start(const Mixer& mixer)
+{
+    if (!mask_ || thread_.joinable())
+    {
+        return;
+    }
+    written_ = 0;
+    read_ = 0;
+    dropped_ = 0;
+    running_ = true;
+    thread_ = std::thread{[this, &mixer] { dispatch(mixer); }};
+}
+
+void EventStream::stop()
+{
+    running_ = false;
+    if (thread_.joinable())
+    {
+        signal_.fetch_add(1, std::memory_order_release);
+        signal_.notify_one();
+        thread_.join();
+    }
+}
+
+void EventStream::dispatch(const Mixer& mixer)
+{
+    while (running_)
+    {
+        const uint32_t signal = signal_.load(std::memory_order_acquire);
+        const uint64_t read = read_.load(std::memory_order_relaxed);
+        if (read == written_.load(std::memory_order_acquire))
+        {
+            signal_.wait(signal, std::memory_order_acquire);
+            continue;
+        }
+
+        const PlayerEvent& event = ring_[read % capacity];
+        const uint64_t played = mixer.getFramesPlayed();
+        if (event.frame > played)
+        {
+            // sleep until it gets heard, in short steps so that stop() never waits long
+            const auto ahead = std::chrono::microseconds{(event.frame - played) * 1000000ull / mixer.getOutputRate()};
+            std::this_thread::sleep_for(std::min<std::chrono::microseconds>(ahead, std::chrono::milliseconds{10}));
+            continue;
+        }
+
+        callback_(context_, event);
+        read_.store(read + 1, std::memory_order_release);
+    }
+}
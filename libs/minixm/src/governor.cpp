@@ -0,0 +1,49 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/governor.h>
+
+#include <algorithm>
+
+void Governor::update(double mix_seconds, double block_seconds) noexcept
+{
+    const float load = block_seconds > 0 ? static_cast<float>(mix_seconds / block_seconds) : 0.f;
+    if (load > 1.f)
+    {
+        ++status_.overruns;
+    }
+    // a single slow block (a page fault, a preemption) shouldn't drop quality by itself
+    status_.load += (load - status_.load) * 0.25f;
+    ++since_change_;
+
+    int level = status_.level;
+    if (!enabled_.load(std::memory_order_relaxed))
+    {
+        level = 0;
+    }
+    else if (status_.load > step_down_load && since_change_ >= settle_blocks)
+    {
+        level = std::min(level + 1, max_level);
+    }
+    else if (status_.load < step_up_load && level > 0)
+    {
+        if (++calm_ >= calm_blocks)
+        {
+            --level;
+        }
+    }
+    else
+    {
+        calm_ = 0;
+    }
+
+    if (level != status_.level)
+    {
+        status_.level = level;
+        ++status_.level_changes;
+        since_change_ = 0;
+        calm_ = 0;
+    }
+    published_.store(status_);
+}
@@ -12,62 +12,162 @@
 
 #include <minixm/mixer.h>
 
+#include <minixm/trace.h>
+
 #include <algorithm>
+#include <bit>
 #include <cassert>
-#include <cstring>
+#include <chrono>
+#include <functional>
 #include <limits>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINIXM_MIXER_SSE2
+#endif
+
 namespace
 {
+    // the float range that survives truncation to 16 bits unclipped
+    constexpr float s16_min = -32768.f;
+    constexpr float s16_max = 32767.998046875f; // largest float below 32768
+
     void MixerClipCopy_Float32(int16_t* dest, const float* src, size_t len)
     {
         assert(src);
         assert(dest);
-        for (size_t i = 0; i < len * 2; i++)
+        size_t i = 0;
+#ifdef MINIXM_MIXER_SSE2
+        // clamp in float, truncate like the scalar path, and pack (8 samples = 4 frames per round)
+        const __m128 low = _mm_set1_ps(s16_min);
+        const __m128 high = _mm_set1_ps(s16_max);
+        for (; i + 8 <= len * 2; i += 8)
+        {
+            const __m128i a = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), low), high));
+            const __m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), low), high));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packs_epi32(a, b));
+        }
+#endif
+        for (; i < len * 2; i++)
+        {
+            dest[i] = static_cast<int16_t>(std::clamp(src[i], s16_min, s16_max));
+        }
+    }
+
+    void MixerClipCopy_Float32ToS32(int32_t* dest, const float* src, size_t len)
+    {
+        assert(src);
+        assert(dest);
+        size_t i = 0;
+#ifdef MINIXM_MIXER_SSE2
+        const __m128 low = _mm_set1_ps(s16_min);
+        const __m128 high = _mm_set1_ps(s16_max);
+        const __m128 scale = _mm_set1_ps(65536.f);
+        for (; i + 4 <= len * 2; i += 4)
+        {
+            const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), low), high);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_cvttps_epi32(_mm_mul_ps(clamped, scale)));
+        }
+#endif
+        for (; i < len * 2; i++)
         {
-            *dest++ = static_cast<int16_t>(std::clamp(
-                static_cast<int>(*src++),
-                static_cast<int>(std::numeric_limits<int16_t>::min()),
-                static_cast<int>(std::numeric_limits<int16_t>::max())));
+            dest[i] = static_cast<int32_t>(std::clamp(src[i], s16_min, s16_max) * 65536.f);
         }
     }
 }
 
 Mixer::Mixer(std::unique_ptr<IPlaybackDriver> driver, TickFunction* tick_function, void* tick_context, uint16_t bpm,
-             float volume_filter_time_constant) :
+             float volume_filter_time_constant, unsigned int mix_rate) :
     tick_function_{tick_function},
     tick_context_{tick_context},
     driver_{std::move(driver)},
-    time_info_{std::make_unique<TimeInfo[]>(driver_->blocks())},
-    volume_filter_k_{1.f / (1.f + static_cast<float>(driver_->mix_rate()) * volume_filter_time_constant)},
-    mix_buffer_{std::make_unique_for_overwrite<float[]>(driver_->block_size() * 2)},
+    mix_rate_{mix_rate ? mix_rate : driver_->mix_rate()},
+    tick_mask_{0},
+    ticks_published_{0},
+    frames_mixed_{0},
+    volume_filter_k_{1.f / (1.f + static_cast<float>(mix_rate_) * volume_filter_time_constant)},
+    volume_scale_{driver_->sample_format() == SampleFormat::F32 ? 1.f / 32768.f : 1.f},
+    silence_{volume_scale_ / 65536.f}, // a full scale frame times it is half a step
+    mix_buffer_{makeResourceArray<float>(driver_->memory_resource(), driver_->block_size() * 2)},
+    chunk_{makeResourceArray<float>(driver_->memory_resource(), chunk_frames * 2)},
     channel_{},
     mixer_samples_left_{0},
-    bpm_{bpm},
-    last_mixed_time_info_{}
+    bpm_{bpm}
+{
+    // keep the ticks of a whole device buffer at the fastest tempo (255 bpm), with room to spare
+    const uint64_t min_tick_frames = std::max(driver_->mix_rate() * 5u / (255 * 2), 1u);
+    const uint64_t buffered_ticks = driver_->buffer_size() / min_tick_frames + 2;
+    tick_mask_ = std::bit_ceil(buffered_ticks * 2) - 1;
+    ticks_ = makeResourceArray<SeqLock<TickRecord>>(driver_->memory_resource(), tick_mask_ + 1);
+
+    if (mix_rate_ != driver_->mix_rate())
+    {
+        resampler_.emplace(mix_rate_, driver_->mix_rate(), driver_->block_size(), driver_->memory_resource());
+    }
+
+    reset(bpm);
+}
+
+void Mixer::reset(uint16_t bpm) noexcept
 {
     for (auto& channel : channel_)
     {
+        channel = MixerChannel{};
         channel.speed = 1.0f;
     }
+    ticks_published_.store(0, std::memory_order_release);
+    frames_mixed_ = 0;
+    if (resampler_)
+    {
+        resampler_->reset();
+    }
+    mixer_samples_left_ = 0;
+    bpm_ = bpm;
 }
 
 unsigned Mixer::getMixRate() const noexcept
+{
+    return mix_rate_;
+}
+
+unsigned Mixer::getOutputRate() const noexcept
 {
     return driver_->mix_rate();
 }
 
 TimeInfo Mixer::getTimeInfo() const
 {
-    return time_info_[driver_->current_block_played()];
+    TimeInfo info{.samples = driver_->frames_played()};
+
+    // newest tick that started at or before the played frame
+    const uint64_t published = ticks_published_.load(std::memory_order_acquire);
+    const uint64_t oldest = published > tick_mask_ ? published - tick_mask_ : 0;
+    for (uint64_t i = published; i-- > oldest;)
+    {
+        TickRecord record;
+        if (!ticks_[i & tick_mask_].tryLoad(record) || record.index != i)
+        {
+            break; // lapped by the mixer, nothing older is left
+        }
+        info.position = record.position;
+        if (record.frame <= info.samples)
+        {
+            break;
+        }
+    }
+    return info;
+}
+
+uint64_t Mixer::getFramesPlayed() const
+{
+    return driver_->frames_played();
 }
 
 void Mixer::start()
 {
-    driver_->start([](void* arg, size_t block, short data[]) noexcept
+    driver_->start([](void* arg, size_t, void* data, uint32_t frames) noexcept
     {
-        const auto self = static_cast<Mixer*>(arg);
-        self->time_info_[block] = self->fill(data);
+        static_cast<Mixer*>(arg)->fill(data, frames);
     }, this);
 }
 
@@ -78,18 +178,63 @@ void Mixer::stop()
 
 float Mixer::timeFromSamples() const
 {
-    return static_cast<float>(static_cast<double>(time_info_[driver_->current_block_played()].samples) / driver_->
-        mix_rate());
+    return static_cast<float>(static_cast<double>(driver_->frames_played()) / driver_->mix_rate());
 }
 
-const TimeInfo& Mixer::fill(short target[]) noexcept
+void Mixer::fill(void* target, uint32_t frames) noexcept
 {
-    const auto block_size = driver_->block_size();
-    //==============================================================================
-    // MIXBUFFER CLEAR
-    //==============================================================================
+    assert(frames <= driver_->block_size());
+    MINIXM_TRACE_SCOPE_ARG("Mixer::fill", "frames", frames);
+    const auto start = std::chrono::steady_clock::now();
+
+    // float devices take the mix as it is (volumes are scaled to -1..1 already), the others get it converted
+    const SampleFormat format = driver_->sample_format();
+    float* const mixed = format == SampleFormat::F32 ? static_cast<float*>(target) : mix_buffer_.get();
+
+    if (resampler_)
+    {
+        resampler_->process(mixed, frames, [](void* context, float data[], uint32_t count) noexcept
+        {
+            static_cast<Mixer*>(context)->mix(data, count);
+        }, this);
+    }
+    else
+    {
+        mix(mixed, frames);
+    }
 
-    memset(mix_buffer_.get(), 0, block_size * sizeof(float) * 2);
+    // ====================================================================================
+    // CLIP AND COPY BLOCK TO OUTPUT BUFFER
+    // ====================================================================================
+    switch (format)
+    {
+    case SampleFormat::S16:
+        MixerClipCopy_Float32(static_cast<int16_t*>(target), mixed, frames);
+        break;
+    case SampleFormat::S32:
+        MixerClipCopy_Float32ToS32(static_cast<int32_t*>(target), mixed, frames);
+        break;
+    case SampleFormat::F32:
+        break;
+    }
+
+    const auto fill_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    const uint64_t audio_ns = frames * uint64_t{1000000000} / driver_->mix_rate();
+    stats_.recordFill(frames, audio_ns, fill_ns);
+    governor_.update(static_cast<double>(fill_ns) * 1e-9, static_cast<double>(audio_ns) * 1e-9);
+}
+
+MixerStats Mixer::getStats() const
+{
+    MixerStats stats = stats_.snapshot();
+    stats.underruns = driver_->underruns();
+    return stats;
+}
+
+void Mixer::mix(float target[], uint32_t frames) noexcept
+{
+    const auto block_size = frames;
 
     //==============================================================================
     // UPDATE MUSIC
@@ -98,24 +243,105 @@ const TimeInfo& Mixer::fill(short target[]) noexcept
     uint32_t MixedSoFar = 0;
 
     // keep resetting the mix pointer to the beginning of this portion of the ring buffer
-    float* MixPtr = mix_buffer_.get();
+    float* MixPtr = target;
+    float* const chunk_left = chunk_.get();
+    float* const chunk_right = chunk_.get() + chunk_frames;
 
     while (MixedSoFar < block_size)
     {
         if (!mixer_samples_left_)
         {
-            last_mixed_time_info_.position = tick_function_(tick_context_); // update new mod tick
-            mixer_samples_left_ = driver_->mix_rate() * 5 / (bpm_ * 2);
+            // ticks are timed on the driver's clock
+            const uint64_t frame = (frames_mixed_ + MixedSoFar) * driver_->mix_rate() / mix_rate_;
+            const auto tick_start = std::chrono::steady_clock::now();
+            const Position position = tick_function_(tick_context_, frame); // update new mod tick
+            stats_.recordTick(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - tick_start).count()));
+            const uint64_t index = ticks_published_.load(std::memory_order_relaxed);
+            ticks_[index & tick_mask_].store({index, frame, position});
+            ticks_published_.store(index + 1, std::memory_order_release);
+            mixer_samples_left_ = mix_rate_ * 5 / (bpm_ * 2);
         }
 
-        const uint32_t SamplesToMix = std::min(mixer_samples_left_, block_size - MixedSoFar);
+        // one chunk at a time, so that every voice reads and writes the same few KB of L1
+        const uint32_t SamplesToMix = std::min({mixer_samples_left_, block_size - MixedSoFar, chunk_frames});
 
         //==============================================================================================
         // LOOP THROUGH CHANNELS
         //==============================================================================================
-        for (auto& channel : channel_)
+        const uint32_t soloed = soloed_.load(std::memory_order_relaxed);
+        const uint32_t muted = muted_.load(std::memory_order_relaxed) | (soloed ? ~soloed : 0);
+
+        // under load, the governor has quiet voices mixed without interpolation and the quietest ones culled
+        const GovernorLevel& level = governor_.level();
+        const float nearest_below = level.nearest_below * volume_scale_;
+        float cull_below = 0.f;
+        if (level.max_voices < std::size(channel_))
         {
-            channel.mix(MixPtr, SamplesToMix, volume_filter_k_);
+            float gains[std::size(channel_)];
+            uint32_t voices = 0;
+            for (const auto& channel : channel_)
+            {
+                if (channel.sample_ptr)
+                {
+                    gains[voices++] = channel.left_volume + channel.right_volume;
+                }
+            }
+            if (voices > level.max_voices)
+            {
+                std::nth_element(gains, gains + level.max_voices - 1, gains + voices, std::greater<>{});
+                cull_below = gains[level.max_voices - 1];
+            }
+        }
+
+        uint32_t voices_nearest = 0;
+        uint32_t voices_culled = 0;
+        uint32_t voices_active = 0;
+        uint32_t voices_virtual = 0;
+        uint32_t loop_wraps = 0;
+        bool written = false; // the first voice overwrites the chunk, no need to clear it
+        for (size_t index = 0; index < std::size(channel_); ++index)
+        {
+            MixerChannel& channel = channel_[index];
+            const float gain = channel.left_volume + channel.right_volume;
+            VoiceMode mode = VoiceMode::Full;
+            if ((muted >> (index & 31)) & 1)
+            {
+                mode = VoiceMode::Muted;
+            }
+            else if (gain < cull_below)
+            {
+                mode = VoiceMode::Muted;
+                voices_culled += channel.sample_ptr != nullptr;
+            }
+            else if (gain < nearest_below)
+            {
+                mode = VoiceMode::Nearest;
+                voices_nearest += channel.sample_ptr != nullptr;
+            }
+            const bool active = channel.sample_ptr != nullptr;
+            const bool wrote = channel.mix(chunk_left, chunk_right, SamplesToMix, volume_filter_k_, silence_, mode,
+                                           !written);
+            written |= wrote;
+            voices_active += active;
+            voices_virtual += active && !wrote;
+            loop_wraps += channel.loop_wraps;
+            channel.loop_wraps = 0;
+        }
+        governor_.record(voices_nearest, voices_culled);
+        stats_.recordChunk(voices_active, voices_virtual, loop_wraps);
+
+        if (written)
+        {
+            for (uint32_t i = 0; i < SamplesToMix; ++i)
+            {
+                MixPtr[i * 2] = chunk_left[i];
+                MixPtr[i * 2 + 1] = chunk_right[i];
+            }
+        }
+        else
+        {
+            std::fill_n(MixPtr, SamplesToMix * 2, 0.f);
         }
 
         MixedSoFar += SamplesToMix;
@@ -123,13 +349,5 @@ const TimeInfo& Mixer::fill(short target[]) noexcept
         mixer_samples_left_ -= SamplesToMix;
     }
 
-    last_mixed_time_info_.samples += MixedSoFar;
-    // This is (and was before) approximated down by as much as 1ms per block
-
-    // ====================================================================================
-    // CLIP AND COPY BLOCK TO OUTPUT BUFFER
-    // ====================================================================================
-    MixerClipCopy_Float32(target, mix_buffer_.get(), block_size);
-
-    return last_mixed_time_info_;
+    frames_mixed_ += MixedSoFar;
 }
@@ -12,86 +12,258 @@
 
 #include <minixm/mixer_channel.h>
 
+#include <minixm/adpcm.h>
+#include <minixm/trace.h>
+
+#include <algorithm>
 #include <cmath>
 
-void MixerChannel::mix(float* mixptr, uint32_t len, float filter_k)
+namespace
 {
-    if (!sample_ptr)
+    struct Pcm16Frames
     {
-        return;
-    }
-    uint32_t sample_index = 0;
-    const auto loop_start = static_cast<float>(sample_ptr->header.loop_start);
-    const auto loop_length = static_cast<float>(sample_ptr->header.loop_length);
-    auto loop_end = static_cast<float>(loop_start + loop_length);
-
-    // Fixes potential bug: previously mix_positionwe play the sample until the end, and we wrapped back into the loop
-    const auto loop_mode = (speed > 0 && mix_position > loop_end) ? XMLoopMode::Off : sample_ptr->header.loop_mode;
-    if (loop_mode == XMLoopMode::Off) {
-        loop_end = static_cast<float>(sample_ptr->header.length);
-    }
-    auto sample_target = (speed > 0) ? loop_end : loop_start;
+        const int16_t* frames;
+
+        float operator[](uint32_t i) const noexcept { return frames[i]; }
+    };
+
+    struct Pcm8Frames
+    {
+        const int8_t* frames;
+
+        float operator[](uint32_t i) const noexcept { return static_cast<float>(frames[i]) * 256.f; }
+    };
 
-    //==============================================================================================
-    // LOOP THROUGH CHANNELS
-    //==============================================================================================
-    while (len > sample_index)
+    // decodes two blocks at a time, so that the frame after any frame read is decoded along with it
+    class AdpcmFrames
     {
-        // Ensure that we don't try to mix a negative amount of samples
-        const auto samples_to_mix_target = static_cast<uint32_t>(ceilf(std::max(
-            0.f, (sample_target - mix_position) / speed))); // round up the division
+        const uint8_t* blocks_;
+        uint32_t block_count_;
+        uint32_t first_ = 0;
+        uint32_t count_ = 0;
+        int16_t frames_[adpcm::block_frames * 2];
 
-        // =========================================================================================
-        // the following code sets up a mix counter. it sees what will happen first, will the output buffer
-        // end be reached first or will the end of the sample be reached first?
-        // whatever is smallest will be the mix_count.
-        const auto mix_count = std::min(len - sample_index, samples_to_mix_target);
+    public:
+        AdpcmFrames(const uint8_t* blocks, uint32_t block_count) noexcept :
+            blocks_{blocks},
+            block_count_{block_count}
+        {
+        }
 
-        //= SET UP VOLUME MULTIPLIERS ==================================================
+        float operator[](uint32_t i) noexcept
+        {
+            if (i - first_ >= count_)
+            {
+                const uint32_t block = i / adpcm::block_frames;
+                adpcm::decodeBlock(blocks_ + block * adpcm::block_bytes, frames_);
+                count_ = adpcm::block_frames;
+                if (block + 1 < block_count_)
+                {
+                    adpcm::decodeBlock(blocks_ + (block + 1) * adpcm::block_bytes, frames_ + adpcm::block_frames);
+                    count_ += adpcm::block_frames;
+                }
+                first_ = block * adpcm::block_frames;
+            }
+            return frames_[i - first_];
+        }
+    };
 
-        for (uint32_t i = 0; i < mix_count; ++i)
+    // the inner loop of MixerChannel::mix, for count frames with no loop or sample end in between
+    template <bool Interpolate, typename Frames>
+    void mixFrames(MixerChannel& channel, Frames& frames, float* left, float* right, uint32_t count, float scale,
+                   float left_volume, float right_volume, float filter_k, bool overwrite)
+    {
+        float mix_position = channel.mix_position;
+        float filtered_left_volume = channel.filtered_left_volume;
+        float filtered_right_volume = channel.filtered_right_volume;
+        for (uint32_t i = 0; i < count; ++i)
         {
-            const auto mixpos = static_cast<uint32_t>(mix_position);
-            const float frac = mix_position - static_cast<float>(mixpos);
-            const auto samp0 = static_cast<float>(sample_ptr->buff[mixpos]);
-            const auto samp1 = static_cast<float>(sample_ptr->buff[mixpos + 1]);
-            const auto newsamp = (samp1 - samp0) * frac + samp0;
-            mixptr[0 + (sample_index + i) * 2] += filtered_left_volume * newsamp;
-            mixptr[1 + (sample_index + i) * 2] += filtered_right_volume * newsamp;
+            const float position = mix_position * scale;
+            const auto mixpos = static_cast<uint32_t>(position);
+            const float frac = position - static_cast<float>(mixpos);
+            float newsamp = frames[mixpos];
+            if constexpr (Interpolate)
+            {
+                const float samp1 = frames[mixpos + 1];
+                newsamp += (samp1 - newsamp) * frac;
+            }
+            if (overwrite)
+            {
+                left[i] = filtered_left_volume * newsamp;
+                right[i] = filtered_right_volume * newsamp;
+            }
+            else
+            {
+                left[i] += filtered_left_volume * newsamp;
+                right[i] += filtered_right_volume * newsamp;
+            }
             filtered_left_volume += (left_volume - filtered_left_volume) * filter_k;
             filtered_right_volume += (right_volume - filtered_right_volume) * filter_k;
-            mix_position += speed;
+            mix_position += channel.speed;
         }
+        channel.mix_position = mix_position;
+        channel.filtered_left_volume = filtered_left_volume;
+        channel.filtered_right_volume = filtered_right_volume;
+    }
+
+    template <bool Interpolate, typename Frames>
+    bool mixSample(MixerChannel& channel, Frames frames, float* left, float* right, uint32_t len, float scale,
+                   float left_volume, float right_volume, float filter_k, bool overwrite)
+    {
+        const Sample* sample = channel.sample_ptr;
+        uint32_t sample_index = 0;
+        // loops are laid out forward only and long (see Sample), so this mostly mixes long uninterrupted runs
+        const auto loop_length = static_cast<float>(sample->mix_loop_length);
+        const auto loop_end = static_cast<float>(sample->mix_loop_start + sample->mix_loop_length);
 
-        sample_index += mix_count;
+        // Channel::sendToMixer starts looped samples inside the loop. Only the frames up to the loop end are stored
+        // for them (see Sample::storedFrames), so one that got past it anyway stops there instead of reading on.
+        const bool looped = sample->mix_looped && channel.mix_position <= loop_end;
+        const float sample_target = sample->mix_looped ? loop_end : static_cast<float>(sample->header.length);
 
-        //=============================================================================================
-        // SWITCH ON LOOP MODE TYPE
-        //=============================================================================================
-        if (mix_count == samples_to_mix_target)
+        //==============================================================================================
+        // LOOP THROUGH CHANNELS
+        //==============================================================================================
+        while (len > sample_index)
         {
-            switch (loop_mode)
+            // Ensure that we don't try to mix a negative amount of samples
+            const auto samples_to_mix_target = static_cast<uint32_t>(ceilf(std::max(
+                0.f, (sample_target - channel.mix_position) / channel.speed))); // round up the division
+
+            // =========================================================================================
+            // the following code sets up a mix counter. it sees what will happen first, will the output buffer
+            // end be reached first or will the end of the sample be reached first?
+            // whatever is smallest will be the mix_count.
+            const auto mix_count = std::min(len - sample_index, samples_to_mix_target);
+
+            mixFrames<Interpolate>(channel, frames, left + sample_index, right + sample_index, mix_count, scale,
+                                   left_volume, right_volume, filter_k, overwrite);
+
+            sample_index += mix_count;
+
+            //=============================================================================================
+            // SWITCH ON LOOP MODE TYPE
+            //=============================================================================================
+            if (mix_count == samples_to_mix_target)
             {
-            case XMLoopMode::Normal:
-                do
+                if (looped)
                 {
-                    mix_position -= loop_length;
-                } while (mix_position >= loop_end);
-                break;
-            case XMLoopMode::Bidi:
-                do
+                    do
+                    {
+                        channel.mix_position -= loop_length;
+                        ++channel.loop_wraps;
+                    } while (channel.mix_position >= loop_end);
+                }
+                else
                 {
-                    mix_position = 2 * sample_target - mix_position - 1;
-                    speed = -speed;
-                    sample_target = (speed > 0) ? loop_end : loop_start;
-                } while ((sample_target - mix_position) * speed < 0.f);
-                break;
-            case XMLoopMode::Off:
-            default:
-                mix_position = 0;
-                sample_ptr = nullptr;
-                return;
+                    channel.mix_position = 0;
+                    channel.sample_ptr = nullptr;
+                    if (overwrite)
+                    {
+                        std::fill(left + sample_index, left + len, 0.f);
+                        std::fill(right + sample_index, right + len, 0.f);
+                    }
+                    return true;
+                }
             }
         }
+        return true;
+    }
+
+    template <bool Interpolate>
+    bool mixVoice(MixerChannel& channel, float* left, float* right, uint32_t len, float target_left,
+                  float target_right, float filter_k, bool overwrite)
+    {
+        const Sample& sample = *channel.sample_ptr;
+
+        // with mip maps, read the level where a frame of output steps less than two frames: positions stay the same
+        const int16_t* mip = nullptr;
+        float scale = 1.f;
+        for (uint32_t level = 0; level < Sample::max_mip_levels && sample.mip_buff[level] &&
+             channel.speed * scale >= 2.f; ++level)
+        {
+            mip = sample.mip_buff[level].get();
+            scale *= 0.5f;
+        }
+        if (mip)
+        {
+            return mixSample<Interpolate>(channel, Pcm16Frames{mip}, left, right, len, scale, target_left,
+                                          target_right, filter_k, overwrite);
+        }
+
+        switch (sample.storage)
+        {
+        case SampleStorage::PCM8:
+            return mixSample<Interpolate>(channel, Pcm8Frames{sample.buff8.get()}, left, right, len, scale,
+                                          target_left, target_right, filter_k, overwrite);
+        case SampleStorage::ADPCM:
+            return mixSample<Interpolate>(channel,
+                                          AdpcmFrames{sample.adpcm.get(), adpcm::blockCount(sample.storedFrames())},
+                                          left, right, len, scale, target_left, target_right, filter_k, overwrite);
+        case SampleStorage::PCM16:
+        default:
+            return mixSample<Interpolate>(channel, Pcm16Frames{sample.buff.get()}, left, right, len, scale,
+                                          target_left, target_right, filter_k, overwrite);
+        }
+    }
+}
+
+void MixerChannel::advance(uint32_t len) noexcept
+{
+    const Sample& sample = *sample_ptr;
+    const auto loop_start = static_cast<float>(sample.mix_loop_start);
+    const auto loop_length = static_cast<float>(sample.mix_loop_length);
+    const float loop_end = loop_start + loop_length;
+    // as in mixSample: bidi loops are laid out forward already, so wrapping is all there is to it
+    const bool looped = sample.mix_looped && mix_position <= loop_end;
+    const float sample_end = sample.mix_looped ? loop_end : static_cast<float>(sample.header.length);
+
+    mix_position += speed * static_cast<float>(len);
+    if (looped)
+    {
+        if (mix_position >= loop_end)
+        {
+            loop_wraps += static_cast<uint32_t>((mix_position - loop_start) / loop_length);
+            mix_position = loop_start + fmodf(mix_position - loop_start, loop_length);
+        }
+    }
+    else if (mix_position >= sample_end)
+    {
+        mix_position = 0;
+        sample_ptr = nullptr;
+    }
+}
+
+bool MixerChannel::mix(float* left, float* right, uint32_t len, float filter_k, float silence, VoiceMode mode,
+                       bool overwrite)
+{
+    if (!sample_ptr)
+    {
+        return false;
+    }
+    if (!sample_ptr->resident.load(std::memory_order_acquire))
+    {
+        // evicted, and not back in time for this note
+        sample_ptr = nullptr;
+        return false;
+    }
+
+    const bool muted = mode == VoiceMode::Muted;
+    const float target_left = muted ? 0.f : left_volume;
+    const float target_right = muted ? 0.f : right_volume;
+    if (std::max({target_left, target_right, filtered_left_volume, filtered_right_volume}) < silence)
+    {
+        // virtual until it can be heard again, the volume ramp has nothing left to do
+        filtered_left_volume = target_left;
+        filtered_right_volume = target_right;
+        advance(len);
+        return false;
+    }
+
+    MINIXM_TRACE_SCOPE_ARGS("MixerChannel::mix", "frames", len, "nearest", mode == VoiceMode::Nearest);
+    if (mode == VoiceMode::Nearest)
+    {
+        return mixVoice<false>(*this, left, right, len, target_left, target_right, filter_k, overwrite);
     }
+    return mixVoice<true>(*this, left, right, len, target_left, target_right, filter_k, overwrite);
 }
@@ -12,88 +12,432 @@
 
 #include <minixm/module.h>
 
+#include <minixm/adpcm.h>
 #include <minixm/channel.h>
+#include <minixm/residency.h>
+#include <minixm/sample_store.h>
 #include <minixm/xmeffects.h>
 
-#include <xmformat/pattern_header.h>
+#include <xmformat/parser.h>
 
-Module::Module(const minifmod::FileAccess& fileAccess, void* fp,
-               SampleLoadFunction* sample_load_callback)
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <vector>
+
+namespace
 {
-    fileAccess.seek(fp, 0, SEEK_SET);
-    fileAccess.read(&header_, sizeof(header_), fp);
-#ifndef FMUSIC_XM_AMIGAPERIODS_ACTIVE
-    header_.flags |= FMUSIC_XMFLAGS_LINEARFREQUENCY;
-#endif
+    template <typename T>
+    void layOutFrames(const Sample& sample, std::shared_ptr<T[]>& frames, std::pmr::memory_resource* memory)
+    {
+        const XMSampleHeader& header = sample.header;
+        if (!sample.mix_looped)
+        {
+            std::fill_n(frames.get() + header.length, 8, T{0});
+            return;
+        }
 
-    // seek to patterndata
-    fileAccess.seek(fp, static_cast<int>(60 + header_.header_size), SEEK_SET);
+        const uint32_t loop_start = header.loop_start;
+        const uint32_t loop_end = header.loop_start + header.loop_length;
+        const uint32_t period = header.loop_mode == XMLoopMode::Bidi ? header.loop_length * 2 : header.loop_length;
+        const uint32_t end = sample.storedFrames();
 
-    // unpack and read patterns
-    for (int pattern_index = 0; pattern_index < static_cast<int>(header_.patterns_count); pattern_index++)
+        auto buff = makeSharedResourceArray<T>(memory, end);
+        std::copy_n(frames.get(), loop_end, buff.get());
+        if (header.loop_mode == XMLoopMode::Bidi)
+        {
+            std::reverse_copy(frames.get() + loop_start, frames.get() + loop_end, buff.get() + loop_end);
+        }
+        for (uint32_t i = loop_start + period; i < end; i++)
+        {
+            buff[i] = buff[i - period];
+        }
+        frames = std::move(buff);
+    }
+
+    // Lays the sample out for the mixer: bidi loops become a forward loop over the loop and its mirror image,
+    // and short loops are repeated until they are long enough. A guard frame after the end continues the loop.
+    void prepareMixLoop(Sample& sample, std::pmr::memory_resource* memory)
     {
-        XMPatternHeader pattern_header;
-        fileAccess.read(&pattern_header, sizeof(pattern_header), fp);
+        const XMSampleHeader& header = sample.header;
+        if (header.loop_mode == XMLoopMode::Off)
+        {
+            sample.mix_loop_start = 0;
+            sample.mix_loop_length = header.length;
+            sample.mix_looped = false;
+        }
+        else
+        {
+            const uint32_t period = header.loop_mode == XMLoopMode::Bidi ? header.loop_length * 2 : header.loop_length;
+            const uint32_t repeats = (Sample::min_mix_loop_length + period - 1) / period;
+            sample.mix_loop_start = header.loop_start;
+            sample.mix_loop_length = period * repeats;
+            sample.mix_looped = true;
+        }
+
+        if (sample.storage == SampleStorage::PCM8)
+        {
+            layOutFrames(sample, sample.buff8, memory);
+        }
+        else
+        {
+            layOutFrames(sample, sample.buff, memory);
+        }
+    }
+
+    // frame i of the sample as the mixer plays it: looping forever past its end, silent outside of it.
+    // With periodic set, frames before the loop are taken from the loop instead, as heard once it wrapped around.
+    float mixFrame(const Sample& sample, int64_t i, bool periodic)
+    {
+        const int64_t loop_start = sample.mix_loop_start;
+        const int64_t loop_length = sample.mix_loop_length;
+        if (sample.mix_looped && (i >= loop_start + loop_length || (periodic && i < loop_start)))
+        {
+            i = loop_start + ((i - loop_start) % loop_length + loop_length) % loop_length;
+        }
+        if (i < 0 || i >= loop_start + loop_length)
+        {
+            return 0.f;
+        }
+        return sample.storage == SampleStorage::PCM8 ? sample.buff8[i] * 256.f : sample.buff[i];
+    }
 
-        Pattern& pattern = pattern_[pattern_index];
-        pattern.resize(pattern_header.rows);
+    void buildMipMaps(Sample& sample, std::pmr::memory_resource* memory)
+    {
+        constexpr int half_taps = 8; // per side, at the rate of the level
+        const uint32_t end = sample.mix_loop_start + sample.mix_loop_length;
 
-        if (pattern_header.packed_pattern_data_size > 0)
+        for (uint32_t level = 0; level < Sample::max_mip_levels; ++level)
         {
-            for (int row = 0; row < static_cast<int>(pattern_header.rows); ++row)
+            const uint32_t factor = 2u << level;
+            if (end / factor < 2)
             {
-                auto& current_row = pattern[row];
+                break;
+            }
 
-                for (int channel_index = 0; channel_index < static_cast<int>(header_.channels_count); channel_index++)
+            // windowed sinc lowpass a little under the level's Nyquist frequency, on buff's frames
+            const int half_width = half_taps * static_cast<int>(factor);
+            std::pmr::vector<float> kernel(2 * half_width + 1, orDefault(memory));
+            double sum = 0;
+            for (int j = -half_width; j <= half_width; ++j)
+            {
+                const double x = static_cast<double>(j) / factor;
+                const double sinc = j == 0 ? 1.0 : sin(std::numbers::pi * x * 0.9) / (std::numbers::pi * x * 0.9);
+                const double blackman = 0.42 + 0.5 * cos(std::numbers::pi * j / half_width) +
+                    0.08 * cos(2 * std::numbers::pi * j / half_width);
+                kernel[j + half_width] = static_cast<float>(sinc * blackman);
+                sum += sinc * blackman;
+            }
+            for (float& k : kernel)
+            {
+                k = static_cast<float>(k / sum);
+            }
+
+            // the mixer reads up to the frame after the end of the loop, a guard like buff's covers that
+            const uint32_t frames = Sample::mipFrames(end + 8, level);
+            auto buff = makeSharedResourceArray<int16_t>(memory, frames);
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                const int64_t center = static_cast<int64_t>(i) * factor;
+                const bool periodic = center >= sample.mix_loop_start;
+                float value = 0.f;
+                for (int j = -half_width; j <= half_width; ++j)
                 {
-                    unsigned char dat;
+                    value += kernel[j + half_width] * mixFrame(sample, center + j, periodic);
+                }
+                buff[i] = static_cast<int16_t>(std::clamp(lrintf(value), -32768l, 32767l));
+            }
+            sample.mip_buff[level] = std::move(buff);
+        }
+    }
 
-                    XMPatternCell& pattern_cell = current_row[channel_index];
+    // replaces the PCM frames, guard included, with ADPCM blocks
+    void encodeAdpcm(Sample& sample, std::pmr::memory_resource* memory)
+    {
+        const uint32_t frames = sample.storedFrames();
+        if (sample.storage == SampleStorage::PCM8)
+        {
+            sample.buff = makeSharedResourceArray<int16_t>(memory, frames);
+            for (uint32_t i = 0; i < frames; i++)
+            {
+                sample.buff[i] = static_cast<int16_t>(sample.buff8[i] * 256);
+            }
+            sample.buff8.reset();
+        }
+        sample.adpcm = makeSharedResourceArray<uint8_t>(memory, adpcm::blockCount(frames) * adpcm::block_bytes);
+        adpcm::encode(sample.buff.get(), frames, sample.adpcm.get());
+        sample.buff.reset();
+        sample.storage = SampleStorage::ADPCM;
+    }
 
-                    fileAccess.read(&dat, 1, fp);
-                    if (dat & 0x80)
-                    {
-                        if (dat & 1) fileAccess.read(&pattern_cell.note, 1, fp);
-                        if (dat & 2) fileAccess.read(&pattern_cell.instrument_number, 1, fp);
-                        if (dat & 4) fileAccess.read(&pattern_cell.volume, 1, fp);
-                        if (dat & 8) fileAccess.read(&pattern_cell.effect, 1, fp);
-                        if (dat & 16) fileAccess.read(&pattern_cell.effect_parameter, 1, fp);
-                    }
-                    else
+    void prepareSample(Sample& sample, const ModuleLoadOptions& options)
+    {
+        prepareMixLoop(sample, options.memory);
+        if (options.mip_maps)
+        {
+            buildMipMaps(sample, options.memory);
+        }
+        if (options.adpcm)
+        {
+            encodeAdpcm(sample, options.memory);
+        }
+        if (options.store)
+        {
+            options.store->share(sample);
+        }
+    }
+
+    // room for the frames of sample, in its own width
+    void allocateFrames(Sample& sample, const ModuleLoadOptions& options)
+    {
+        if (sample.header.bits16)
+        {
+            sample.buff = makeSharedResourceArray<int16_t>(options.memory, sample.header.length + 8);
+            sample.storage = SampleStorage::PCM16;
+        }
+        else
+        {
+            sample.buff8 = makeSharedResourceArray<int8_t>(options.memory, sample.header.length + 8);
+            sample.storage = SampleStorage::PCM8;
+        }
+    }
+
+    // DO DELTA CONVERSION, in the sample's own width
+    void decodeDeltas(Sample& sample) noexcept
+    {
+        if (sample.storage == SampleStorage::PCM16)
+        {
+            int16_t previous_value = 0;
+            for (uint32_t i = 0; i < sample.header.length; i++)
+            {
+                sample.buff[i] = previous_value = static_cast<int16_t>(sample.buff[i] + previous_value);
+            }
+        }
+        else
+        {
+            int8_t previous_value = 0;
+            for (uint32_t i = 0; i < sample.header.length; i++)
+            {
+                sample.buff8[i] = previous_value = static_cast<int8_t>(sample.buff8[i] + previous_value);
+            }
+        }
+    }
+
+    // Builds a module out of what XMParser finds, reading sample data straight into the samples' frames
+    class ModuleReader final : public XMParserHandler
+    {
+        Module& module_;
+        Module::SampleLoadFunction* sample_load_callback_;
+        const ModuleLoadOptions& options_;
+        XMParser parser_{*this, XMParseAll, orDefault(options_.memory)};
+
+        bool header_ = false;
+        int channels_ = 0; // in the file's patterns, maybe more than the player's 32
+        std::shared_ptr<Pattern[]> patterns_;
+        // the instrument whose samples are coming
+        int instrument_ = -1;
+        bool dropped_instrument_ = false; // past the 128 the player has, samples included
+        int sample_headers_ = 0;
+        uint32_t stored_bytes_[16]{};
+        uint32_t received_bytes_[16]{};
+        bool complete_[16]{};
+
+        // records how many patterns and instruments are done, false if the load was cancelled
+        bool step(uint32_t done)
+        {
+            LoadProgress* const progress = options_.progress;
+            if (!progress)
+            {
+                return true;
+            }
+            if (progress->cancelled())
+            {
+                module_.header_.song_length = 0;
+                module_.header_.patterns_count = 0;
+                module_.header_.instruments_count = 0;
+                return false;
+            }
+            progress->done.store(done, std::memory_order_relaxed);
+            return true;
+        }
+
+        void completeSample(int index)
+        {
+            Sample& sample = module_.instrument_[instrument_].sample[index];
+            if (sample_load_callback_)
+            {
+                sample_load_callback_(sample.buff.get(), sample.header.length, instrument_, index);
+            }
+            else
+            {
+                decodeDeltas(sample);
+            }
+            prepareSample(sample, options_);
+            complete_[index] = true;
+        }
+
+    public:
+        ModuleReader(Module& module, Module::SampleLoadFunction* sample_load_callback,
+                     const ModuleLoadOptions& options) :
+            module_{module},
+            sample_load_callback_{sample_load_callback},
+            options_{options}
+        {
+        }
+
+        bool feed(const uint8_t* data, size_t size) { return parser_.feed(data, size); }
+        [[nodiscard]] bool done() const noexcept { return parser_.done(); }
+
+        // Leaves a module cut short consistent: what didn't arrive is left out, samples cut short are completed
+        // with silence. False if the load was cancelled.
+        bool finish()
+        {
+            if (!step(module_.header_.patterns_count + module_.header_.instruments_count))
+            {
+                return false;
+            }
+            if (parser_.done())
+            {
+                return true;
+            }
+            if (!header_)
+            {
+                module_.header_ = {};
+            }
+            module_.header_.instruments_count = static_cast<uint16_t>(instrument_ + 1);
+            if (instrument_ < 0)
+            {
+                return true;
+            }
+            Instrument& instrument = module_.instrument_[instrument_];
+            instrument.header.samples_count = static_cast<uint16_t>(sample_headers_);
+            for (int index = 0; index < sample_headers_; ++index)
+            {
+                Sample& sample = instrument.sample[index];
+                if (sample.header.length && !complete_[index])
+                {
+                    if (!sample_load_callback_)
                     {
-                        pattern_cell.note = XMNote{dat};
-                        fileAccess.read(reinterpret_cast<char*>(&pattern_cell) + 1, sizeof(XMPatternCell) - 1, fp);
+                        auto* frames = sample.storage == SampleStorage::PCM16 ?
+                                           reinterpret_cast<uint8_t*>(sample.buff.get()) :
+                                           reinterpret_cast<uint8_t*>(sample.buff8.get());
+                        const uint32_t bytes = sample.header.length * (sample.storage == SampleStorage::PCM16 ? 2 : 1);
+                        std::fill(frames + std::min(received_bytes_[index], bytes), frames + bytes, uint8_t{0});
                     }
+                    completeSample(index);
+                }
+            }
+            return true;
+        }
 
+        bool onHeader(const XMHeader& header) override
+        {
+            header_ = true;
+            module_.header_ = header;
+            // the file may be malformed, or made to break players: keep what the header says within the fixed
+            // arrays the player indexes with it
+            channels_ = header.channels_count;
+            module_.header_.song_length = std::min<uint16_t>(uint16_t{header.song_length}, 256);
+            if (module_.header_.restart_position >= module_.header_.song_length)
+            {
+                module_.header_.restart_position = 0;
+            }
+            module_.header_.channels_count = std::min<uint16_t>(uint16_t{header.channels_count}, 32);
+            module_.header_.instruments_count = std::min<uint16_t>(uint16_t{header.instruments_count}, 128);
+#ifndef FMUSIC_XM_AMIGAPERIODS_ACTIVE
+            module_.header_.flags |= FMUSIC_XMFLAGS_LINEARFREQUENCY;
+#endif
+            if (options_.progress)
+            {
+                options_.progress->total.store(header.patterns_count + header.instruments_count,
+                                               std::memory_order_relaxed);
+            }
+            // orders only reach 256 patterns
+            patterns_ = makeSharedResourceArray<Pattern>(options_.memory, std::min<size_t>(header.patterns_count, 256));
+            module_.pattern_ = patterns_;
+            return true;
+        }
+
+        bool onPattern(int index, const XMPatternHeader& header, const XMPatternCell* cells) override
+        {
+            if (!step(index))
+            {
+                return false;
+            }
+            if (index >= 256)
+            {
+                return true;
+            }
+            Pattern& pattern = patterns_[index];
+            const int rows = std::min<int>(int{header.rows}, 256);
+            pattern.resize(rows);
+
+            const int channels = module_.header_.channels_count;
+            for (int row = 0; row < rows; ++row)
+            {
+                auto& current_row = pattern[row];
+                for (int channel_index = 0; channel_index < channels; channel_index++)
+                {
+                    XMPatternCell& pattern_cell = current_row[channel_index];
+                    pattern_cell = cells[row * channels_ + channel_index];
                     if (pattern_cell.instrument_number > 0x80)
                     {
                         pattern_cell.instrument_number = 0;
                     }
+                    if (pattern_cell.note.value > XMNote::KEY_OFF)
+                    {
+                        pattern_cell.note = {};
+                    }
                 }
             }
+            return true;
         }
-    }
 
-    // load instrument information
-    for (int instrument_index = 0; instrument_index < static_cast<int>(header_.instruments_count); ++instrument_index)
-    {
-        // point a pointer to that particular instrument
-        Instrument& instrument = instrument_[instrument_index];
-
-        int first_sample_offset = fileAccess.tell(fp);
-        fileAccess.read(&instrument.header, sizeof(instrument.header), fp); // instrument size
-        first_sample_offset += static_cast<int>(instrument.header.header_size);
+        bool onInstrument(int index, const XMInstrumentHeader& header,
+                          const XMInstrumentSampleHeader* sample_header) override
+        {
+            if (!step(module_.header_.patterns_count + index))
+            {
+                return false;
+            }
+            if (index >= 128)
+            {
+                dropped_instrument_ = true;
+                return true;
+            }
+            instrument_ = index;
+            dropped_instrument_ = false;
+            sample_headers_ = 0;
+            std::fill_n(complete_, 16, false);
 
-        assert(instrument.header.samples_count <= 16);
+            Instrument& instrument = module_.instrument_[index];
+            instrument.header = header;
+            instrument.header.samples_count = std::min<uint16_t>(uint16_t{header.samples_count}, 16);
 
-        if (instrument.header.samples_count > 0)
-        {
-            fileAccess.read(&instrument.instrument_sample_header, sizeof(instrument.instrument_sample_header), fp);
+            if (!sample_header)
+            {
+                new(&instrument.instrument_sample_header) XMInstrumentSampleHeader{};
+                return true;
+            }
+            instrument.instrument_sample_header = *sample_header;
+            // indices the player follows without checking
+            XMInstrumentSampleHeader& checked = instrument.instrument_sample_header;
+            for (uint8_t& note_sample : checked.note_sample_number)
+            {
+                note_sample = note_sample < 16 ? note_sample : 0;
+            }
+            for (uint8_t* point : {&checked.volume_sustain_index, &checked.volume_loop_start_index,
+                                   &checked.volume_loop_end_index, &checked.pan_sustain_index,
+                                   &checked.pan_loop_start_index, &checked.pan_loop_end_index})
+            {
+                *point = std::min<uint8_t>(uint8_t{*point}, 11);
+            }
 
             auto initialize_envelope = [](EnvelopePoints& e, int count, const XMEnvelopePoint (&original_points)[12],
                                           int offset, float scale, XMEnvelopeFlags flags)
             {
-                e.count = (count < 2 || !(flags & XMEnvelopeFlagsOn)) ? 0 : count;
+                e.count = (count < 2 || !(flags & XMEnvelopeFlagsOn)) ? 0 : std::min(count, 12);
                 for (int i = 0; i < e.count; ++i)
                 {
                     e.envelope[i].position = original_points[i].position;
@@ -123,94 +467,185 @@ Module::Module(const minifmod::FileAccess& fileAccess, void* fp,
                                 instrument.instrument_sample_header.pan_envelope, 32, 32,
                                 instrument.instrument_sample_header.pan_envelope_flags);
 #endif
+            return true;
+        }
+
+        bool onSampleHeader(int instrument_index, int sample_index, const XMSampleHeader& header) override
+        {
+            if (dropped_instrument_ || sample_index >= 16)
+            {
+                return true;
+            }
+            sample_headers_ = sample_index + 1;
+            stored_bytes_[sample_index] = header.length;
+            received_bytes_[sample_index] = 0;
 
+            Sample& sample = module_.instrument_[instrument_index].sample[sample_index];
+            XMSampleHeader& sample_header = sample.header;
+            sample_header = header;
 
-            // seek to first sample
-            fileAccess.seek(fp, first_sample_offset, SEEK_SET);
-            for (int sample_index = 0; sample_index < static_cast<int>(instrument.header.samples_count); sample_index++)
+            // type of sample
+            if (sample_header.bits16)
             {
-                XMSampleHeader& sample_header = instrument.sample[sample_index].header;
+                sample_header.length /= 2;
+                sample_header.loop_start /= 2;
+                sample_header.loop_length /= 2;
+            }
+
+            // keep broken loops inside the sample
+            sample_header.loop_start = std::min(sample_header.loop_start, sample_header.length);
+            sample_header.loop_length = std::min(sample_header.loop_length,
+                                                 sample_header.length - sample_header.loop_start);
 
-                fileAccess.read(&sample_header, sizeof(sample_header), fp);
+            if ((sample_header.loop_mode == XMLoopMode::Off) || (sample_header.length == 0) ||
+                (sample_header.loop_length == 0))
+            {
+                sample_header.loop_start = 0;
+                sample_header.loop_length = sample_header.length;
+                sample_header.loop_mode = XMLoopMode::Off;
+            }
+
+            //= ALLOCATE MEMORY FOR THE SAMPLE BUFFER ==============================================
+            if (!sample_header.length)
+            {
+                complete_[sample_index] = true;
+            }
+            else if (sample_load_callback_)
+            {
+                sample.buff = makeSharedResourceArray<int16_t>(options_.memory, sample_header.length + 8);
+            }
+            else
+            {
+                allocateFrames(sample, options_);
+            }
+            return true;
+        }
 
-                // type of sample
-                if (sample_header.bits16)
+        bool onSampleData(int instrument_index, int sample_index, uint32_t offset, const uint8_t* data,
+                          size_t size) override
+        {
+            if (dropped_instrument_ || sample_index >= 16 || complete_[sample_index])
+            {
+                return true;
+            }
+            Sample& sample = module_.instrument_[instrument_index].sample[sample_index];
+            if (!sample_load_callback_)
+            {
+                if (!offset)
                 {
-                    sample_header.length /= 2;
-                    sample_header.loop_start /= 2;
-                    sample_header.loop_length /= 2;
+                    sample.file_offset = static_cast<long>(parser_.offset());
                 }
-
-                if ((sample_header.loop_mode == XMLoopMode::Off) || (sample_header.length == 0))
+                auto* frames = sample.storage == SampleStorage::PCM16 ?
+                                   reinterpret_cast<uint8_t*>(sample.buff.get()) :
+                                   reinterpret_cast<uint8_t*>(sample.buff8.get());
+                const uint32_t bytes = sample.header.length * (sample.storage == SampleStorage::PCM16 ? 2 : 1);
+                if (offset < bytes)
                 {
-                    sample_header.loop_start = 0;
-                    sample_header.loop_length = sample_header.length;
-                    sample_header.loop_mode = XMLoopMode::Off;
+                    memcpy(frames + offset, data, std::min<size_t>(size, bytes - offset));
                 }
             }
-
-            // Load sample data
-            for (int sample_index = 0; sample_index < static_cast<int>(instrument.header.samples_count); sample_index++)
+            received_bytes_[sample_index] = offset + static_cast<uint32_t>(size);
+            if (received_bytes_[sample_index] == stored_bytes_[sample_index])
             {
-                //unsigned int	samplelenbytes = sample.header.length * sample.bits / 8;
-
-                //= ALLOCATE MEMORY FOR THE SAMPLE BUFFER ==============================================
+                completeSample(sample_index);
+            }
+            return true;
+        }
+    };
 
-                if (Sample& sample = instrument.sample[sample_index]; sample.header.length)
-                {
-                    sample.buff.reset(new int16_t[sample.header.length + 8]);
+}
 
-                    if (sample_load_callback)
-                    {
-                        sample_load_callback(sample.buff.get(), sample.header.length, instrument_index, sample_index);
-                        fileAccess.seek(fp, static_cast<int>(sample.header.length * (sample.header.bits16 ? 2 : 1)),
-                                        SEEK_CUR);
-                    }
-                    else
-                    {
-                        if (sample.header.bits16)
-                        {
-                            fileAccess.read(sample.buff.get(), static_cast<int>(sample.header.length * sizeof(short)),
-                                            fp);
-                        }
-                        else
-                        {
-                            auto buff = std::unique_ptr<int8_t[]>(new int8_t[sample.header.length + 8]);
-                            fileAccess.read(buff.get(), static_cast<int>(sample.header.length), fp);
-                            for (uint32_t i = 0; i < sample.header.length; i++)
-                            {
-                                sample.buff[i] = static_cast<int16_t>(buff[i] * 256);
-                            }
-
-                            sample.header.bits16 = true;
-                        }
-
-                        // DO DELTA CONVERSION
-                        int16_t previous_value = 0;
-                        for (uint32_t i = 0; i < sample.header.length; i++)
-                        {
-                            sample.buff[i] = previous_value = static_cast<int16_t>(sample.buff[i] + previous_value);
-                        }
-                    }
+bool Module::loadSample(Sample& sample, const minifmod::FileAccess& fileAccess, void* fp,
+                        const ModuleLoadOptions& options)
+{
+    allocateFrames(sample, options);
+    const bool complete = sample.storage == SampleStorage::PCM16 ?
+                              fileAccess.read(sample.buff.get(), sample.header.length * sizeof(int16_t), fp) ==
+                              sample.header.length * sizeof(int16_t) :
+                              fileAccess.read(sample.buff8.get(), sample.header.length, fp) == sample.header.length;
+    if (!complete)
+    {
+        sample.buff.reset();
+        sample.buff8.reset();
+        return false;
+    }
+    decodeDeltas(sample);
+    prepareSample(sample, options);
+    return true;
+}
 
-                    // BUGFIX 1.3 - removed click for end of non looping sample (also size optimized a bit)
-                    if (sample.header.loop_mode == XMLoopMode::Bidi)
-                    {
-                        sample.buff[sample.header.loop_start + sample.header.loop_length] = sample.buff[sample.header.
-                            loop_start + sample.header.loop_length - 1]; // fix it
-                    }
-                    else if (sample.header.loop_mode == XMLoopMode::Normal)
-                    {
-                        sample.buff[sample.header.loop_start + sample.header.loop_length] = sample.buff[sample.header.
-                            loop_start]; // fix it
-                    }
-                }
-            }
-        }
-        else
+Module::Module(const minifmod::FileAccess& fileAccess, void* fp,
+               SampleLoadFunction* sample_load_callback, const ModuleLoadOptions& options)
+{
+    // only the rewind seeks, a stream can ignore it
+    fileAccess.seek(fp, 0, SEEK_SET);
+    ModuleReader reader{*this, sample_load_callback, options};
+    uint8_t chunk[4096];
+    while (!reader.done())
+    {
+        const size_t count = fileAccess.read(chunk, sizeof(chunk), fp);
+        if (!count || !reader.feed(chunk, count))
         {
-            new(&instrument.instrument_sample_header) XMInstrumentSampleHeader{};
-            fileAccess.seek(fp, first_sample_offset, SEEK_SET);
+            break;
         }
     }
+    if (!reader.finish())
+    {
+        return; // cancelled
+    }
+    if (options.residency)
+    {
+        residency_ = options.residency;
+        residency_->add(*this, fileAccess, options.name, options);
+    }
+}
+
+Module::~Module()
+{
+    if (residency_)
+    {
+        residency_->remove(*this);
+    }
+}
+
+namespace
+{
+    // ahead of each module, the resource it came from and its size, for operator delete
+    struct ModulePrefix final
+    {
+        std::pmr::memory_resource* memory;
+        size_t size;
+    };
+
+    constexpr size_t module_prefix_size = alignof(std::max_align_t);
+    static_assert(sizeof(ModulePrefix) <= module_prefix_size);
+}
+
+void* Module::operator new(size_t size, std::pmr::memory_resource* memory)
+{
+    memory = orDefault(memory);
+    auto* p = static_cast<uint8_t*>(memory->allocate(module_prefix_size + size, alignof(std::max_align_t)));
+    new (p) ModulePrefix{memory, size};
+    return p + module_prefix_size;
+}
+
+void* Module::operator new(size_t size)
+{
+    return operator new(size, nullptr);
+}
+
+void Module::operator delete(void* p) noexcept
+{
+    if (!p)
+    {
+        return;
+    }
+    auto* block = static_cast<uint8_t*>(p) - module_prefix_size;
+    const ModulePrefix prefix = *reinterpret_cast<ModulePrefix*>(block);
+    prefix.memory->deallocate(block, module_prefix_size + prefix.size, alignof(std::max_align_t));
+}
+
+void Module::operator delete(void* p, std::pmr::memory_resource*) noexcept
+{
+    operator delete(p);
 }
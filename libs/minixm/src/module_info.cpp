@@ -0,0 +1,103 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/module_info.h>
+
+#include <xmformat/parser.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    // XM names are padded with spaces or zeros
+    template <size_t N>
+    std::string trimmed(const char (&name)[N])
+    {
+        size_t length = strnlen(name, N);
+        while (length && name[length - 1] == ' ')
+        {
+            --length;
+        }
+        return {name, length};
+    }
+
+    class InfoReader final : public XMParserHandler
+    {
+        ModuleInfo& info_;
+
+    public:
+        explicit InfoReader(ModuleInfo& info) : info_{info} {}
+
+        bool onHeader(const XMHeader& header) override
+        {
+            if (memcmp(header.header, "Extended Module: ", sizeof(header.header)))
+            {
+                return false;
+            }
+            info_.name = trimmed(header.module_name);
+            info_.tracker = trimmed(header.tracker_name);
+            info_.channels = header.channels_count;
+            info_.song_length = header.song_length;
+            info_.patterns = header.patterns_count;
+            info_.instruments = header.instruments_count;
+            info_.tempo = header.default_tempo;
+            info_.bpm = header.default_bpm;
+            info_.linear_frequencies = header.flags & FMUSIC_XMFLAGS_LINEARFREQUENCY;
+            info_.instrument_names.reserve(header.instruments_count);
+            return true;
+        }
+
+        bool onPattern(int, const XMPatternHeader& header, const XMPatternCell*) override
+        {
+            info_.rows += header.rows;
+            return true;
+        }
+
+        bool onInstrument(int, const XMInstrumentHeader& header, const XMInstrumentSampleHeader*) override
+        {
+            info_.instrument_names.push_back(trimmed(header.instrument_name));
+            return true;
+        }
+
+        bool onSampleHeader(int, int, const XMSampleHeader& header) override
+        {
+            if (header.length)
+            {
+                ++info_.samples;
+                info_.sample_bytes += header.length;
+            }
+            return true;
+        }
+
+        bool onSampleData(int, int, uint32_t, const uint8_t*, size_t) override
+        {
+            return true;
+        }
+    };
+}
+
+bool scanModule(const minifmod::FileAccess& fileAccess, void* fp, ModuleInfo& info)
+{
+    info = {};
+    InfoReader reader{info};
+    XMParser parser{reader, XMParseHeaders};
+
+    // small reads, most of a module is what gets skipped
+    uint8_t chunk[1024];
+    while (!parser.done())
+    {
+        if (const uint64_t skip = parser.skippable())
+        {
+            fileAccess.seek(fp, static_cast<long>(skip), SEEK_CUR);
+            parser.skip(skip);
+        }
+        const size_t count = fileAccess.read(chunk, sizeof(chunk), fp);
+        if (!count || !parser.feed(chunk, count))
+        {
+            return false;
+        }
+    }
+    return true;
+}
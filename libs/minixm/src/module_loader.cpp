@@ -0,0 +1,297 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/module_loader.h>
+
+#include <minixm/residency.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+
+struct ModuleLoader::Job final
+{
+    minifmod::FileAccess source{};
+    std::string name;
+    ModuleLoadOptions options;
+    LoadProgress own_progress; // when options didn't bring one
+    std::promise<std::unique_ptr<Module>> promise;
+
+    // the reading thread fills data up to filled, which only grows
+    std::mutex mutex;
+    std::condition_variable arrived;
+    void* fp = nullptr;
+    ResourceArray<uint8_t> data; // the whole file, from options.memory
+    size_t size = 0;
+    size_t filled = 0;
+    bool opened = false;
+    bool finished = false; // nothing more will arrive: read to the end, failed or cancelled
+    std::exception_ptr read_error; // what the reading failed with, if it threw
+
+    // the decoding thread reads data through a FileAccess of its own
+    size_t position = 0;
+    size_t visible = 0; // filled, as last seen, so that most reads don't lock
+
+    void finish(std::exception_ptr error = nullptr) noexcept
+    {
+        if (fp)
+        {
+            source.close(fp);
+            fp = nullptr;
+        }
+        std::lock_guard lock{mutex};
+        finished = true;
+        read_error = std::move(error);
+        arrived.notify_all();
+    }
+
+    // reads the next chunk, false when there's no more
+    bool readChunk()
+    {
+        if (options.progress->cancelled())
+        {
+            finish();
+            return false;
+        }
+        if (!opened)
+        {
+            fp = source.open(name.c_str());
+            if (!fp)
+            {
+                finish();
+                return false;
+            }
+            source.seek(fp, 0, SEEK_END);
+            const long end = source.tell(fp);
+            source.seek(fp, 0, SEEK_SET);
+            size = end > 0 ? static_cast<size_t>(end) : 0;
+            data = makeResourceArray<uint8_t>(options.memory, size);
+
+            std::lock_guard lock{mutex};
+            opened = true;
+            arrived.notify_all();
+        }
+
+        const size_t count = filled < size ?
+            source.read(data.get() + filled, std::min(chunk_bytes, size - filled), fp) : 0;
+        bool done;
+        {
+            std::lock_guard lock{mutex};
+            filled += count;
+            done = !count || filled == size;
+            arrived.notify_all();
+        }
+        if (done)
+        {
+            finish();
+        }
+        return !done;
+    }
+
+    static void* bufferOpen(void*, const char*) { return nullptr; }
+    static void bufferClose(void*, void*) {}
+
+    static size_t bufferRead(void* user, void* buffer, size_t count, void*)
+    {
+        Job& job = *static_cast<Job*>(user);
+        const size_t end = std::min(job.position + count, job.size);
+        if (job.visible < end)
+        {
+            std::unique_lock lock{job.mutex};
+            job.arrived.wait(lock, [&job, end] { return job.finished || job.filled >= end; });
+            job.visible = job.filled;
+        }
+        if (job.position >= job.visible)
+        {
+            return 0;
+        }
+        count = std::min(count, job.visible - job.position);
+        memcpy(buffer, job.data.get() + job.position, count);
+        job.position += count;
+        return count;
+    }
+
+    static void bufferSeek(void* user, void*, long pos, int mode)
+    {
+        Job& job = *static_cast<Job*>(user);
+        const long base = mode == SEEK_CUR ? static_cast<long>(job.position) :
+                          mode == SEEK_END ? static_cast<long>(job.size) : 0;
+        job.position = static_cast<size_t>(std::max(base + pos, 0l));
+    }
+
+    static long bufferTell(void* user, void*)
+    {
+        return static_cast<long>(static_cast<Job*>(user)->position);
+    }
+
+    std::unique_ptr<Module> decode()
+    {
+        {
+            std::unique_lock lock{mutex};
+            arrived.wait(lock, [this] { return opened || finished; });
+            if (read_error)
+            {
+                std::rethrow_exception(read_error);
+            }
+            if (!opened)
+            {
+                return {};
+            }
+        }
+
+        // residency reloads from the source, not from the buffer
+        ModuleLoadOptions decode_options = options;
+        decode_options.residency = nullptr;
+        const minifmod::FileAccess buffered{bufferOpen, bufferClose, bufferRead, bufferSeek, bufferTell, this};
+        std::unique_ptr<Module> module{new (options.memory) Module{buffered, this, nullptr, decode_options}};
+        if (options.progress->cancelled())
+        {
+            return {};
+        }
+        {
+            // a module cut short by a failed read isn't what was asked for
+            std::lock_guard lock{mutex};
+            if (read_error)
+            {
+                std::rethrow_exception(read_error);
+            }
+        }
+        if (options.residency)
+        {
+            ModuleLoadOptions residency_options = options;
+            residency_options.progress = nullptr;
+            module->residency_ = options.residency;
+            options.residency->add(*module, source, name.c_str(), residency_options);
+        }
+        return module;
+    }
+};
+
+ModuleLoader::ModuleLoader(unsigned int decode_threads) :
+    reader_{[this] { read(); }}
+{
+    for (unsigned int i = 0; i < std::max(decode_threads, 1u); ++i)
+    {
+        decoders_.emplace_back([this] { decode(); });
+    }
+}
+
+ModuleLoader::~ModuleLoader()
+{
+    {
+        std::lock_guard lock{mutex_};
+        running_ = false;
+        for (const auto* jobs : {&reads_, &decodes_})
+        {
+            for (const auto& job : *jobs)
+            {
+                job->options.progress->cancel();
+            }
+        }
+        for (const auto& job : active_)
+        {
+            job->options.progress->cancel();
+        }
+    }
+    changed_.notify_all();
+    reader_.join();
+
+    // the decoding threads may be waiting for data that won't come now
+    for (const auto& job : reads_)
+    {
+        job->finish();
+    }
+    for (std::thread& decoder : decoders_)
+    {
+        decoder.join();
+    }
+    for (const auto& job : decodes_)
+    {
+        job->promise.set_value(nullptr);
+    }
+}
+
+std::future<std::unique_ptr<Module>> ModuleLoader::load(const minifmod::FileAccess& fileAccess, const char* name,
+                                                        const ModuleLoadOptions& options)
+{
+    auto job = std::make_shared<Job>();
+    job->source = fileAccess;
+    job->name = name ? name : "";
+    job->options = options;
+    job->options.name = job->name.c_str();
+    if (!job->options.progress)
+    {
+        job->options.progress = &job->own_progress;
+    }
+    auto future = job->promise.get_future();
+    {
+        std::lock_guard lock{mutex_};
+        reads_.push_back(job);
+        decodes_.push_back(std::move(job));
+    }
+    changed_.notify_all();
+    return future;
+}
+
+void ModuleLoader::read()
+{
+    std::unique_lock lock{mutex_};
+    while (true)
+    {
+        changed_.wait(lock, [this] { return !running_ || !reads_.empty(); });
+        if (!running_)
+        {
+            return;
+        }
+        std::shared_ptr<Job> job = std::move(reads_.front());
+        reads_.pop_front();
+
+        lock.unlock();
+        bool more = false;
+        try
+        {
+            more = job->readChunk();
+        }
+        catch (...)
+        {
+            job->finish(std::current_exception());
+        }
+        lock.lock();
+        if (more)
+        {
+            reads_.push_back(std::move(job));
+        }
+    }
+}
+
+void ModuleLoader::decode()
+{
+    std::unique_lock lock{mutex_};
+    while (true)
+    {
+        changed_.wait(lock, [this] { return !running_ || !decodes_.empty(); });
+        if (!running_)
+        {
+            return;
+        }
+        std::shared_ptr<Job> job = std::move(decodes_.front());
+        decodes_.pop_front();
+        active_.push_back(job);
+
+        lock.unlock();
+        // an exhausted arena throws std::bad_alloc, which must not take the thread, and the process, down
+        try
+        {
+            job->promise.set_value(job->decode());
+        }
+        catch (...)
+        {
+            job->promise.set_exception(std::current_exception());
+        }
+        lock.lock();
+        std::erase(active_, job);
+    }
+}
@@ -12,6 +12,7 @@
 
 #include <minixm/player_state.h>
 
+#include <minixm/trace.h>
 #include <minixm/xmeffects.h>
 
 #include <xmformat/sample_header.h>
@@ -61,11 +62,14 @@ namespace
     }
 }
 
-Position PlayerState::tick()
+Position PlayerState::tick(uint64_t frame)
 {
+    MINIXM_TRACE_SCOPE_ARG("PlayerState::tick", "tick", tick_);
+    tick_frame_ = frame;
     if (tick_ == 0) // new note
     {
         updateNote(); // Update and play the note
+        pushEvent(PlayerEvent::ROW);
     }
     else
     {
@@ -82,6 +86,7 @@ Position PlayerState::tick()
         channel.sendToMixer(mixer_, instrument, global_volume_,
                             module_->header_.flags & FMUSIC_XMFLAGS_LINEARFREQUENCY);
     }
+    pushEvent(PlayerEvent::TICK);
 
     tick_++;
     if (tick_ >= ticks_per_row_ + pattern_delay_)
@@ -96,12 +101,13 @@ void PlayerState::updateNote()
 {
     // process any rows commands to set the next order/row
     current_ = next_;
+    MINIXM_TRACE_SCOPE_ARGS("PlayerState::updateNote", "order", current_.order, "row", current_.row);
 
     bool row_set = false;
 
     // Point our note pointer to the correct pattern buffer, and to the
     // correct offset in this buffer indicated by row and number of channels
-    const auto& pattern = module_->pattern_[module_->header_.pattern_order[current_.order]];
+    const auto& pattern = module_->getPattern(module_->header_.pattern_order[current_.order]);
     const auto& row = pattern[current_.row];
 
     // Loop through each channel in the row until we have finished
@@ -192,6 +198,15 @@ void PlayerState::updateNote()
         }
 #endif
 
+        if (valid_note)
+        {
+            pushEvent(PlayerEvent::NOTE, channel_index, note.value);
+        }
+        if (effect == XMEffect::Z)
+        {
+            pushEvent(PlayerEvent::SYNC, channel_index, effect_parameter);
+        }
+
         //= PROCESS TICK 0 EFFECTS =====================================================================
         switch (effect)
         {
@@ -568,9 +583,10 @@ void PlayerState::updateNote()
 
 void PlayerState::updateTick()
 {
+    MINIXM_TRACE_SCOPE_ARGS("PlayerState::updateTick", "order", current_.order, "row", current_.row);
     // Point our note pointer to the correct pattern buffer, and to the
     // correct offset in this buffer indicated by row and number of channels
-    const auto& pattern = module_->pattern_[module_->header_.pattern_order[current_.order]];
+    const auto& pattern = module_->getPattern(module_->header_.pattern_order[current_.order]);
     const auto& row = pattern[current_.row];
 
     // Loop through each channel in the row until we have finished
@@ -837,21 +853,47 @@ void PlayerState::updateTick()
     }
 }
 
-PlayerState::PlayerState(std::unique_ptr<IPlaybackDriver> driver, std::unique_ptr<Module> module) :
+PlayerState::PlayerState(std::unique_ptr<IPlaybackDriver> driver, std::unique_ptr<Module> module,
+                         unsigned int mix_rate) :
     module_{std::move(module)},
+    events_{driver->memory_resource()},
     mixer_{
-        std::move(driver), [](void* context) { return static_cast<PlayerState*>(context)->tick(); }, this,
-        module_->header_.default_bpm
+        std::move(driver),
+        [](void* context, uint64_t frame) { return static_cast<PlayerState*>(context)->tick(frame); }, this,
+        module_->header_.default_bpm, 0.003f, mix_rate
     },
     global_volume_{64},
     tick_{0},
     ticks_per_row_{module_->header_.default_tempo},
     pattern_delay_{0},
     current_{0, 0},
-    next_{0, 0}
+    next_{0, 0},
+    tick_frame_{0}
 {
     for (int channel_index = 0; channel_index < static_cast<int>(module_->header_.channels_count); channel_index++)
     {
         channels_[channel_index].index = channel_index;
     }
 }
+
+std::unique_ptr<Module> PlayerState::reset(std::unique_ptr<Module> module)
+{
+    std::swap(module_, module);
+    mixer_.reset(module_->header_.default_bpm);
+    for (int channel_index = 0; channel_index < static_cast<int>(std::size(channels_)); channel_index++)
+    {
+        channels_[channel_index] = Channel{};
+        channels_[channel_index].index = channel_index;
+    }
+    global_volume_ = 64;
+    tick_ = 0;
+    ticks_per_row_ = module_->header_.default_tempo;
+    pattern_delay_ = 0;
+    current_ = {0, 0};
+    next_ = {0, 0};
+    tick_frame_ = 0;
+#ifdef FMUSIC_XM_GLOBALVOLSLIDE_ACTIVE
+    global_volume_slide_ = 0;
+#endif
+    return module;
+}
@@ -0,0 +1,138 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/resampler.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINIXM_RESAMPLER_SSE2
+#endif
+
+namespace
+{
+    // one output frame: taps interleaved input frames against taps duplicated coefficients
+    void convolve(float* out, const float* in, const float* coefficients) noexcept
+    {
+#ifdef MINIXM_RESAMPLER_SSE2
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (uint32_t i = 0; i < Resampler::taps * 2; i += 8)
+        {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(coefficients + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(in + i + 4), _mm_loadu_ps(coefficients + i + 4)));
+        }
+        const __m128 sum = _mm_add_ps(sum0, sum1); // L R L R
+        const __m128 lr = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        _mm_storel_pi(reinterpret_cast<__m64*>(out), lr);
+#else
+        float left = 0.f;
+        float right = 0.f;
+        for (uint32_t i = 0; i < Resampler::taps * 2; i += 2)
+        {
+            left += in[i] * coefficients[i];
+            right += in[i + 1] * coefficients[i + 1];
+        }
+        out[0] = left;
+        out[1] = right;
+#endif
+    }
+}
+
+Resampler::Resampler(uint32_t input_rate, uint32_t output_rate, uint32_t max_pull, std::pmr::memory_resource* memory) :
+    step_{input_rate / std::gcd(input_rate, output_rate)},
+    phases_{output_rate / std::gcd(input_rate, output_rate)},
+    table_phases_{std::min(phases_, max_phases)},
+    table_{makeResourceArray<float>(memory, table_phases_ * taps * 2)},
+    max_pull_{max_pull},
+    capacity_{taps + max_pull + step_ / phases_ + 1},
+    input_{makeResourceArray<float>(memory, capacity_ * 2)},
+    count_{0},
+    index_{0},
+    phase_{0}
+{
+    // when going down in rate, cut below the output's Nyquist frequency
+    const double cutoff = std::min(1.0, static_cast<double>(output_rate) / input_rate) * 0.95;
+    constexpr double half = taps / 2;
+
+    float* coefficients = table_.get();
+    for (uint32_t phase = 0; phase < table_phases_; ++phase)
+    {
+        const double fraction = static_cast<double>(phase) / table_phases_;
+        double sum = 0;
+        double h[taps];
+        for (uint32_t j = 0; j < taps; ++j)
+        {
+            // distance from the output instant to input frame index_ + j
+            const double x = j - (half - 1) - fraction;
+            const double sinc = x == 0 ? 1.0 : sin(std::numbers::pi * x * cutoff) / (std::numbers::pi * x * cutoff);
+            const double blackman = 0.42 + 0.5 * cos(std::numbers::pi * x / half) +
+                0.08 * cos(2 * std::numbers::pi * x / half);
+            h[j] = sinc * blackman;
+            sum += h[j];
+        }
+        for (uint32_t j = 0; j < taps; ++j)
+        {
+            // normalized, so that DC goes through at unity gain on every phase
+            float* pair = coefficients + (phase * taps + j) * 2;
+            pair[0] = pair[1] = static_cast<float>(h[j] / sum);
+        }
+    }
+
+    reset();
+}
+
+void Resampler::reset() noexcept
+{
+    // the filter is centered between frames half - 1 and half: start with silence before the first frame
+    count_ = taps / 2 - 1;
+    std::fill_n(input_.get(), count_ * 2, 0.f);
+    index_ = 0;
+    phase_ = 0;
+}
+
+void Resampler::process(float output[], uint32_t frames, PullFunction* pull, void* context) noexcept
+{
+    while (frames)
+    {
+        while (frames && index_ + taps <= count_)
+        {
+            const uint32_t table_phase = static_cast<uint32_t>(static_cast<uint64_t>(phase_) * table_phases_ / phases_);
+            convolve(output, input_.get() + index_ * 2, table_.get() + table_phase * taps * 2);
+            output += 2;
+            --frames;
+
+            phase_ += step_;
+            index_ += phase_ / phases_;
+            phase_ %= phases_;
+        }
+        if (!frames)
+        {
+            break;
+        }
+
+        // keep what is still under the filter (when going down in rate, the filter may have skipped past it all)
+        const uint32_t keep = count_ > index_ ? count_ - index_ : 0;
+        memmove(input_.get(), input_.get() + (count_ - keep) * 2, keep * 2 * sizeof(float));
+        index_ -= count_ - keep;
+        count_ = keep;
+
+        // and pull just enough for the rest of the outputs
+        const uint64_t last_index = index_ + (phase_ + static_cast<uint64_t>(frames - 1) * step_) / phases_;
+        const auto wanted = static_cast<uint32_t>(std::min<uint64_t>(last_index + taps, capacity_));
+        assert(wanted > count_);
+        while (count_ < wanted)
+        {
+            const uint32_t count = std::min(wanted - count_, max_pull_);
+            pull(context, input_.get() + count_ * 2, count);
+            count_ += count;
+        }
+    }
+}
@@ -0,0 +1,395 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/residency.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+
+namespace
+{
+    // samples holding the frames, in any module
+    long holdersOf(const Sample& sample) noexcept
+    {
+        return sample.buff ? sample.buff.use_count() : sample.buff8 ? sample.buff8.use_count() :
+                                                                      sample.adpcm.use_count();
+    }
+
+    void freeFrames(Sample& sample) noexcept
+    {
+        sample.resident.store(false, std::memory_order_relaxed);
+        sample.buff.reset();
+        sample.buff8.reset();
+        sample.adpcm.reset();
+        for (auto& mip : sample.mip_buff)
+        {
+            mip.reset();
+        }
+    }
+
+    // the first order each sample is played at, following the instrument and note each channel plays
+    void findFirstOrders(const Module& module, int first_orders[128][16])
+    {
+        const XMHeader& header = module.header_;
+        std::fill_n(&first_orders[0][0], 128 * 16, static_cast<int>(header.song_length));
+
+        int instruments[32]{};
+        XMNote notes[32]{};
+        for (int order = 0; order < header.song_length; ++order)
+        {
+            const Pattern& pattern = module.getPattern(header.pattern_order[order]);
+            for (int row = 0; row < pattern.size(); ++row)
+            {
+                for (int channel = 0; channel < std::min<int>(header.channels_count, 32); ++channel)
+                {
+                    const XMPatternCell& cell = pattern[row][channel];
+                    if (cell.instrument_number && cell.instrument_number <= header.instruments_count)
+                    {
+                        instruments[channel] = cell.instrument_number;
+                    }
+                    if (cell.note.isValid())
+                    {
+                        notes[channel] = cell.note;
+                    }
+                    if (instruments[channel] && notes[channel].isValid() &&
+                        (cell.instrument_number || cell.note.isValid()))
+                    {
+                        const Instrument& instrument = module.instrument_[instruments[channel] - 1];
+                        const int sample = instrument.instrument_sample_header.note_sample_number[notes[channel].value - 1];
+                        if (sample >= 0 && sample < 16)
+                        {
+                            int& first_order = first_orders[instruments[channel] - 1][sample];
+                            first_order = std::min(first_order, order);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SampleResidency::SampleResidency(size_t budget_bytes) :
+    budget_{budget_bytes},
+    thread_{[this] { run(); }}
+{
+}
+
+SampleResidency::~SampleResidency()
+{
+    {
+        std::lock_guard lock{mutex_};
+        running_ = false;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+SampleResidency::ModuleEntry* SampleResidency::find(const Module& module) noexcept
+{
+    const auto it = std::find_if(modules_.begin(), modules_.end(),
+                                 [&module](const auto& entry) { return entry->module == &module; });
+    return it != modules_.end() ? it->get() : nullptr;
+}
+
+void SampleResidency::add(Module& module, const minifmod::FileAccess& fileAccess, const char* name,
+                          const ModuleLoadOptions& options)
+{
+    auto entry = std::make_unique<ModuleEntry>();
+    entry->module = &module;
+    entry->file_access = fileAccess;
+    entry->name = name ? name : "";
+    entry->options = options;
+
+    int first_orders[128][16];
+    findFirstOrders(module, first_orders);
+    for (int instrument = 0; instrument < module.header_.instruments_count; ++instrument)
+    {
+        for (int index = 0; index < static_cast<int>(module.instrument_[instrument].header.samples_count); ++index)
+        {
+            Sample& sample = module.instrument_[instrument].sample[index];
+            if (sample.header.length)
+            {
+                entry->samples.push_back({&sample, first_orders[instrument][index], 0, nullptr, State::Resident});
+            }
+        }
+    }
+
+    std::lock_guard lock{mutex_};
+    for (SampleEntry& sample : entry->samples)
+    {
+        charge(sample);
+    }
+    entry->last_used = ++clock_;
+    modules_.push_back(std::move(entry));
+    enforceBudget();
+}
+
+void SampleResidency::remove(const Module& module)
+{
+    std::unique_lock lock{mutex_};
+    ModuleEntry* entry = find(module);
+    if (!entry)
+    {
+        return;
+    }
+    std::erase_if(queue_, [entry](const auto& job) { return job.first == entry; });
+    changed_.wait(lock, [entry]
+    {
+        return std::none_of(entry->samples.begin(), entry->samples.end(),
+                            [](const SampleEntry& sample) { return sample.state == State::Loading; });
+    });
+    for (SampleEntry& sample : entry->samples)
+    {
+        discharge(sample);
+    }
+    std::erase_if(modules_, [entry](const auto& candidate) { return candidate.get() == entry; });
+}
+
+bool SampleResidency::load(std::unique_lock<std::mutex>& lock, ModuleEntry& entry, SampleEntry& sample)
+{
+    sample.state = State::Loading;
+    lock.unlock();
+
+    // the file may have been cut or replaced since, and the frames come from options.memory, which may run out
+    bool loaded = false;
+    if (void* fp = entry.file_access.open(entry.name.c_str()))
+    {
+        entry.file_access.seek(fp, sample.sample->file_offset, SEEK_SET);
+        try
+        {
+            loaded = Module::loadSample(*sample.sample, entry.file_access, fp, entry.options);
+        }
+        catch (const std::bad_alloc&)
+        {
+        }
+        entry.file_access.close(fp);
+    }
+    if (!loaded)
+    {
+        freeFrames(*sample.sample);
+    }
+
+    lock.lock();
+    if (loaded)
+    {
+        charge(sample);
+        sample.state = State::Resident;
+        sample.sample->resident.store(true, std::memory_order_release);
+    }
+    else
+    {
+        sample.state = State::Evicted;
+    }
+    changed_.notify_all();
+    return loaded;
+}
+
+void SampleResidency::enforceBudget() noexcept
+{
+    while (resident_bytes_ > budget_)
+    {
+        // the module that played the longest time ago, and in it the sample needed the furthest into the song
+        ModuleEntry* victim_module = nullptr;
+        SampleEntry* victim = nullptr;
+        for (const auto& entry : modules_)
+        {
+            if (entry->pins || (victim_module && entry->last_used >= victim_module->last_used))
+            {
+                continue;
+            }
+            SampleEntry* candidate = nullptr;
+            for (SampleEntry& sample : entry->samples)
+            {
+                if (sample.state == State::Resident && sample.sample->file_offset >= 0 && !entry->name.empty() &&
+                    (!candidate || sample.first_order > candidate->first_order) && evictable(sample))
+                {
+                    candidate = &sample;
+                }
+            }
+            if (candidate)
+            {
+                victim_module = entry.get();
+                victim = candidate;
+            }
+        }
+        if (!victim)
+        {
+            return; // all that's left is playing
+        }
+
+        evict(*victim);
+    }
+}
+
+void SampleResidency::charge(SampleEntry& sample)
+{
+    sample.frames = sample.sample->frameData(); // the same for samples sharing them through a SampleStore
+    sample.bytes = sample.frames ? sample.sample->frameBytes() : 0;
+    if (sample.frames && ++charged_[sample.frames] == 1)
+    {
+        resident_bytes_ += sample.bytes;
+    }
+}
+
+void SampleResidency::discharge(SampleEntry& sample) noexcept
+{
+    if (!sample.frames)
+    {
+        return;
+    }
+    const auto it = charged_.find(sample.frames);
+    if (!--it->second)
+    {
+        resident_bytes_ -= sample.bytes;
+        charged_.erase(it);
+    }
+    sample.frames = nullptr;
+    sample.bytes = 0;
+}
+
+// evicting frees memory: nothing outside this residency holds the frames, and no module using them is playing
+bool SampleResidency::evictable(const SampleEntry& sample) const noexcept
+{
+    const long holders = holdersOf(*sample.sample);
+    if (holders == 1)
+    {
+        return true;
+    }
+    const auto it = charged_.find(sample.frames);
+    if (it == charged_.end() || static_cast<long>(it->second) != holders)
+    {
+        return false;
+    }
+    for (const auto& entry : modules_)
+    {
+        for (const SampleEntry& other : entry->samples)
+        {
+            if (other.frames == sample.frames && (entry->pins || other.sample->file_offset < 0 ||
+                                                  entry->name.empty()))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// along with every sample sharing its frames
+void SampleResidency::evict(SampleEntry& sample) noexcept
+{
+    const void* const frames = sample.frames;
+    for (const auto& entry : modules_)
+    {
+        for (SampleEntry& other : entry->samples)
+        {
+            if (other.state == State::Resident && other.frames == frames)
+            {
+                discharge(other);
+                freeFrames(*other.sample);
+                other.state = State::Evicted;
+            }
+        }
+    }
+}
+
+bool SampleResidency::acquire(const Module& module)
+{
+    std::unique_lock lock{mutex_};
+    ModuleEntry* entry = find(module);
+    if (!entry)
+    {
+        return true;
+    }
+    ++entry->pins;
+    entry->last_used = ++clock_;
+
+    // missing samples, the soonest needed first
+    std::vector<SampleEntry*> missing;
+    for (SampleEntry& sample : entry->samples)
+    {
+        if (sample.state != State::Resident)
+        {
+            missing.push_back(&sample);
+        }
+    }
+    std::stable_sort(missing.begin(), missing.end(),
+                     [](const SampleEntry* a, const SampleEntry* b) { return a->first_order < b->first_order; });
+
+    bool loaded = true;
+    for (SampleEntry* sample : missing)
+    {
+        if (sample->first_order < ahead_orders && sample->state != State::Loading)
+        {
+            std::erase_if(queue_, [sample](const auto& job) { return &job.first->samples[job.second] == sample; });
+            loaded = load(lock, *entry, *sample) && loaded;
+        }
+        else if (sample->state == State::Evicted)
+        {
+            sample->state = State::Queued;
+            queue_.emplace_back(entry, sample - entry->samples.data());
+        }
+    }
+
+    // and the worker may have been loading some of the first ones already
+    changed_.wait(lock, [entry]
+    {
+        return std::none_of(entry->samples.begin(), entry->samples.end(), [](const SampleEntry& sample)
+        {
+            return sample.first_order < ahead_orders && sample.state == State::Loading;
+        });
+    });
+    changed_.notify_all();
+    enforceBudget();
+    return loaded && std::none_of(missing.begin(), missing.end(), [](const SampleEntry* sample)
+    {
+        return sample->first_order < ahead_orders && sample->state != State::Resident;
+    });
+}
+
+void SampleResidency::release(const Module& module)
+{
+    std::lock_guard lock{mutex_};
+    if (ModuleEntry* entry = find(module); entry && entry->pins)
+    {
+        --entry->pins;
+        entry->last_used = ++clock_;
+        enforceBudget();
+    }
+}
+
+size_t SampleResidency::residentBytes()
+{
+    std::lock_guard lock{mutex_};
+    return resident_bytes_;
+}
+
+void SampleResidency::run()
+{
+    std::unique_lock lock{mutex_};
+    while (true)
+    {
+        changed_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+        if (!running_)
+        {
+            return;
+        }
+        auto [entry, index] = queue_.front();
+        queue_.pop_front();
+
+        SampleEntry& sample = entry->samples[index];
+        if (sample.state != State::Queued)
+        {
+            continue;
+        }
+        if (!entry->pins)
+        {
+            // stopped before its turn came
+            sample.state = State::Evicted;
+            continue;
+        }
+        load(lock, *entry, sample);
+        enforceBudget();
+    }
+}
@@ -0,0 +1,113 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/sample_store.h>
+
+#include <cstring>
+
+namespace
+{
+    uint64_t hashFrames(const Sample& sample) noexcept
+    {
+        const size_t bytes = sample.storedBytes();
+        const auto* data = static_cast<const uint8_t*>(sample.frameData());
+
+        // 64 bit FNV-1a over 8 bytes at a time, with the loop and the storage mixed in first
+        constexpr uint64_t prime = 0x100000001b3ull;
+        uint64_t hash = 0xcbf29ce484222325ull;
+        const uint64_t loop[] = {
+            static_cast<uint64_t>(sample.storage), sample.mix_looped, sample.mix_loop_start, sample.mix_loop_length
+        };
+        for (const uint64_t word : loop)
+        {
+            hash = (hash ^ word) * prime;
+        }
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < bytes; ++i)
+        {
+            hash = (hash ^ data[i]) * prime;
+        }
+        return hash;
+    }
+}
+
+void SampleStore::share(Sample& sample)
+{
+    const size_t bytes = sample.storedBytes();
+    const void* data = sample.frameData();
+    if (!data)
+    {
+        return;
+    }
+    const uint64_t hash = hashFrames(sample);
+
+    std::lock_guard lock{mutex_};
+    auto [first, last] = entries_.equal_range(hash);
+    for (auto it = first; it != last;)
+    {
+        Entry& entry = it->second;
+        Sample shared;
+        shared.buff = entry.buff.lock();
+        shared.buff8 = entry.buff8.lock();
+        shared.adpcm = entry.adpcm.lock();
+        if (!shared.buff && !shared.buff8 && !shared.adpcm)
+        {
+            it = entries_.erase(it); // its samples are all gone
+            continue;
+        }
+        shared.storage = entry.storage;
+        shared.mix_loop_start = entry.mix_loop_start;
+        shared.mix_loop_length = entry.mix_loop_length;
+        shared.mix_looped = entry.mix_looped;
+
+        const size_t shared_bytes = shared.storedBytes();
+        const void* shared_data = shared.frameData();
+        const bool same_mips = [&]
+        {
+            for (uint32_t level = 0; level < Sample::max_mip_levels; ++level)
+            {
+                if (!sample.mip_buff[level] != entry.mip_buff[level].expired())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }();
+        if (shared.storage == sample.storage && shared.mix_looped == sample.mix_looped &&
+            shared.mix_loop_start == sample.mix_loop_start && shared.mix_loop_length == sample.mix_loop_length &&
+            same_mips && shared_data && shared_bytes == bytes && !memcmp(shared_data, data, bytes))
+        {
+            shared_bytes_ += sample.frameBytes();
+            sample.buff = std::move(shared.buff);
+            sample.buff8 = std::move(shared.buff8);
+            sample.adpcm = std::move(shared.adpcm);
+            for (uint32_t level = 0; level < Sample::max_mip_levels; ++level)
+            {
+                sample.mip_buff[level] = entry.mip_buff[level].lock();
+            }
+            return;
+        }
+        ++it;
+    }
+
+    Entry entry{sample.storage, sample.mix_loop_start, sample.mix_loop_length, sample.mix_looped,
+                sample.buff, sample.buff8, sample.adpcm, {}};
+    for (uint32_t level = 0; level < Sample::max_mip_levels; ++level)
+    {
+        entry.mip_buff[level] = sample.mip_buff[level];
+    }
+    entries_.emplace(hash, std::move(entry));
+}
+
+uint64_t SampleStore::sharedBytes()
+{
+    std::lock_guard lock{mutex_};
+    return shared_bytes_;
+}
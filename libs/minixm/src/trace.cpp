@@ -0,0 +1,229 @@
+/******************************************************************************/
+/* This library (minixm) is maintained by Pan/SpinningKids, 2022-2024         */
+/******************************************************************************/
+
+#include <minixm/trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent final
+    {
+        const TraceSite* site;
+        uint64_t start_ns;
+        uint32_t duration_ns;
+        uint32_t thread; // numbered from 1, in the order threads first record something
+        int32_t args[2];
+    };
+
+    constexpr uint32_t ring_events = 1 << 15; // 1 MB a thread
+
+    // single producer (the thread that claimed it), single consumer (the exporter)
+    struct TraceRing final
+    {
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> claimed{false};
+        TraceEvent events[ring_events];
+    };
+
+    std::atomic<bool> exporting{false};
+
+    std::mutex rings_mutex;
+    // never freed: a ring outlives its thread until drained, then goes to the next thread that needs one
+    std::deque<std::unique_ptr<TraceRing>> rings;
+    uint32_t threads_seen = 0;
+    bool exporter_running = false;
+
+    std::vector<TraceRing*> allRings()
+    {
+        const std::lock_guard lock{rings_mutex};
+        std::vector<TraceRing*> all;
+        for (const auto& ring : rings)
+        {
+            all.push_back(ring.get());
+        }
+        return all;
+    }
+
+    struct RingClaim final
+    {
+        TraceRing* ring = nullptr;
+        uint32_t thread = 0;
+
+        // first event on this thread: takes a lock, and memory if no thread has left a ring behind
+        TraceRing& get()
+        {
+            if (!ring)
+            {
+                const std::lock_guard lock{rings_mutex};
+                for (const auto& candidate : rings)
+                {
+                    if (!candidate->claimed.load(std::memory_order_acquire))
+                    {
+                        ring = candidate.get();
+                        break;
+                    }
+                }
+                if (!ring)
+                {
+                    ring = rings.emplace_back(std::make_unique<TraceRing>()).get();
+                }
+                ring->claimed.store(true, std::memory_order_relaxed);
+                thread = ++threads_seen;
+            }
+            return *ring;
+        }
+
+        ~RingClaim()
+        {
+            if (ring)
+            {
+                ring->claimed.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    thread_local RingClaim ring_claim;
+}
+
+uint64_t traceNow() noexcept
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void traceRecord(const TraceSite& site, uint64_t start_ns, int32_t arg0, int32_t arg1) noexcept
+{
+    if (!exporting.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    const uint64_t duration = traceNow() - start_ns;
+    TraceRing& ring = ring_claim.get();
+    const uint32_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= ring_events)
+    {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring.events[head % ring_events] = {&site, start_ns,
+                                       static_cast<uint32_t>(std::min<uint64_t>(duration,
+                                                                                std::numeric_limits<uint32_t>::max())),
+                                       ring_claim.thread, {arg0, arg1}};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+TraceExporter::TraceExporter(const char* path)
+{
+    const std::lock_guard lock{rings_mutex};
+    if (exporter_running)
+    {
+        return;
+    }
+    file_ = fopen(path, "wb");
+    if (!file_)
+    {
+        return;
+    }
+    exporter_running = true;
+
+    // whatever was recorded since the last exporter stopped
+    for (const auto& ring : rings)
+    {
+        ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+        ring->dropped.store(0, std::memory_order_relaxed);
+    }
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file_);
+    start_ns_ = traceNow();
+    exporting.store(true, std::memory_order_relaxed);
+
+    thread_ = std::thread{[this]
+    {
+        std::unique_lock wait_lock{mutex_};
+        while (!wake_.wait_for(wait_lock, std::chrono::milliseconds{10}, [this] { return stopping_; }))
+        {
+            wait_lock.unlock();
+            drain();
+            wait_lock.lock();
+        }
+    }};
+}
+
+TraceExporter::~TraceExporter()
+{
+    stop();
+}
+
+void TraceExporter::stop()
+{
+    if (!file_)
+    {
+        return;
+    }
+    exporting.store(false, std::memory_order_relaxed);
+    {
+        const std::lock_guard lock{mutex_};
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    drain(); // scopes still closing now are left for the next exporter to discard
+
+    // lost events as a counter, so they show up next to the rest
+    fprintf(file_, "%s{\"name\":\"dropped events\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":0,"
+                   "\"args\":{\"count\":%llu}}\n]}\n",
+            written() ? ",\n" : "", static_cast<unsigned long long>(dropped()));
+    fclose(file_);
+    file_ = nullptr;
+
+    const std::lock_guard lock{rings_mutex};
+    exporter_running = false;
+}
+
+void TraceExporter::drain()
+{
+    uint64_t written = written_.load(std::memory_order_relaxed);
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    for (TraceRing* ring : allRings())
+    {
+        const uint32_t head = ring->head.load(std::memory_order_acquire);
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            const TraceEvent& event = ring->events[tail % ring_events];
+            if (event.start_ns < start_ns_)
+            {
+                continue; // opened before the exporter
+            }
+            const TraceSite& site = *event.site;
+            fprintf(file_, "%s{\"name\":\"%s\",\"cat\":\"minixm\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                           "\"ts\":%.3f,\"dur\":%.3f",
+                    written ? ",\n" : "", site.name, event.thread,
+                    static_cast<double>(event.start_ns - start_ns_) / 1000.0,
+                    static_cast<double>(event.duration_ns) / 1000.0);
+            if (site.arg_names[0])
+            {
+                fprintf(file_, ",\"args\":{\"%s\":%d", site.arg_names[0], event.args[0]);
+                if (site.arg_names[1])
+                {
+                    fprintf(file_, ",\"%s\":%d", site.arg_names[1], event.args[1]);
+                }
+                fputc('}', file_);
+            }
+            fputc('}', file_);
+            ++written;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+        dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    written_.store(written, std::memory_order_relaxed);
+    dropped_.store(dropped, std::memory_order_relaxed);
+}
@@ -0,0 +1,99 @@
+/******************************************************************************/
+/* This library (module_cache) is maintained by Pan/SpinningKids, 2022-2024   */
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <minixm/module.h>
+#include <minixm/system_file.h>
+
+// Shared memory module cache, for hosts running many players (POSIX only).
+// A daemon (ModuleCacheServer) loads each module once into a shared memory object of its own: the header,
+// instruments with their envelopes, patterns and sample frames laid out for the mixer. Clients (ModuleCacheClient)
+// map it read only and get a Module whose patterns and frames point into the mapping, so any number of processes
+// playing a song hold a single copy of it.
+
+// Loads modules for clients over a Unix domain socket, each request on a thread of its own: a module slow to load
+// only holds up the clients asking for that same module
+class ModuleCacheServer final
+{
+public:
+    // a client gets this long to send its request and take the reply, or it is dropped: one that connects and
+    // stalls mustn't hold up the others
+    static constexpr int request_timeout_ms = 1000;
+
+private:
+    // the file a module was loaded from as it was then, to tell when it changes on disk
+    struct FileStamp
+    {
+        int64_t modified_ns = 0;
+        int64_t size = 0;
+
+        bool operator ==(const FileStamp&) const = default;
+    };
+
+    struct Entry
+    {
+        std::string shm_name;
+        uint64_t size;
+        FileStamp stamp;
+    };
+
+    std::string socket_path_;
+    minifmod::FileAccess file_access_;
+    int listener_ = -1;
+    std::atomic<bool> stopping_{false};
+    std::atomic<unsigned int> published_{0};
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_; // a load or a worker finished
+    std::map<std::string, Entry> entries_; // by module name and load options, one for each
+    std::set<std::string> loading_; // keys of entries_ being loaded: other requests for them wait
+    unsigned int workers_ = 0;
+
+    void serve(int client);
+    bool publish(const char* name, const ModuleLoadOptions& options, Entry& entry);
+
+public:
+    // listens on socket_path, replacing whatever socket was there; modules are opened by name through fileAccess
+    ModuleCacheServer(const char* socket_path, const minifmod::FileAccess& fileAccess);
+    ModuleCacheServer(const ModuleCacheServer&) = delete;
+    ModuleCacheServer& operator =(const ModuleCacheServer&) = delete;
+    // removes the socket and the shared memory objects: modules clients already mapped stay valid
+    ~ModuleCacheServer();
+
+    [[nodiscard]] bool listening() const noexcept { return listener_ >= 0; }
+    [[nodiscard]] size_t modules() const
+    {
+        const std::lock_guard lock{mutex_};
+        return entries_.size();
+    }
+
+    // serves requests until stop(), then waits for those under way
+    void run();
+    // safe from signal handlers and other threads
+    void stop() noexcept;
+};
+
+// Maps modules the daemon listening on a socket loaded
+class ModuleCacheClient final
+{
+    std::string socket_path_;
+
+public:
+    explicit ModuleCacheClient(const char* socket_path) : socket_path_{socket_path} {}
+
+    // The module the daemon loads by name (made absolute when it names a file), with options.mip_maps and
+    // options.adpcm; the Module itself comes from options.memory, the rest of options doesn't apply to shared
+    // frames. Null if the daemon can't be reached or can't load it. The mapping lasts as long as anything of the
+    // module does, and is read only: patterns and frames are never written.
+    [[nodiscard]] std::unique_ptr<Module> load(const char* name, const ModuleLoadOptions& options = {}) const;
+};
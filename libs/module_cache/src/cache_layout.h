@@ -0,0 +1,114 @@
+/******************************************************************************/
+/* This library (module_cache) is maintained by Pan/SpinningKids, 2022-2024   */
+/******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/socket.h>
+
+#include <minixm/envelope.h>
+#include <minixm/sample.h>
+
+#include <xmformat/file_header.h>
+#include <xmformat/instrument_header.h>
+#include <xmformat/instrument_sample_header.h>
+
+// What daemon and clients share, built together: a change to any of these structures or to Pattern, Sample or
+// EnvelopePoints needs a new layout_version.
+namespace module_cache
+{
+    constexpr uint32_t layout_version = 1;
+    constexpr char layout_magic[8] = {'M', 'X', 'C', 'A', 'C', 'H', 'E', '\0'};
+    constexpr size_t layout_alignment = 64;
+
+    [[nodiscard]] constexpr uint64_t aligned(uint64_t offset) noexcept
+    {
+        return (offset + layout_alignment - 1) & ~static_cast<uint64_t>(layout_alignment - 1);
+    }
+
+    // offsets are from the start of the shared memory object, 0 when there's nothing
+    struct CachedSample
+    {
+        XMSampleHeader header;
+        SampleStorage storage;
+        bool mix_looped;
+        uint32_t mix_loop_start;
+        uint32_t mix_loop_length;
+        uint64_t frames; // buff, buff8 or adpcm, as storage says
+        uint64_t mip_frames[Sample::max_mip_levels];
+    };
+
+    struct CachedInstrument
+    {
+        XMInstrumentHeader header;
+        XMInstrumentSampleHeader instrument_sample_header;
+        EnvelopePoints volume_envelope;
+        EnvelopePoints pan_envelope;
+        CachedSample sample[16];
+    };
+
+    // at the start of each shared memory object, followed by patterns and frames
+    struct CachedModule
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t layout_size; // sizeof(CachedModule), as a check that both sides were built alike
+        uint64_t size; // of the whole object
+        XMHeader header;
+        uint64_t patterns; // min(header.patterns_count, 256) of them
+        CachedInstrument instrument[128];
+    };
+
+    // the protocol: a request per connection, answered with a reply
+    constexpr uint32_t protocol_version = 1;
+
+    struct CacheRequest
+    {
+        uint32_t version;
+        bool mip_maps;
+        bool adpcm;
+        char name[4096];
+    };
+
+    struct CacheReply
+    {
+        bool loaded;
+        char shm_name[64];
+        uint64_t size;
+    };
+
+    inline bool sendAll(int fd, const void* data, size_t size) noexcept
+    {
+        const auto* p = static_cast<const uint8_t*>(data);
+        while (size)
+        {
+            const ssize_t count = send(fd, p, size, MSG_NOSIGNAL);
+            if (count <= 0)
+            {
+                return false;
+            }
+            p += count;
+            size -= static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    inline bool receiveAll(int fd, void* data, size_t size) noexcept
+    {
+        auto* p = static_cast<uint8_t*>(data);
+        while (size)
+        {
+            const ssize_t count = recv(fd, p, size, 0);
+            if (count <= 0)
+            {
+                return false;
+            }
+            p += count;
+            size -= static_cast<size_t>(count);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,178 @@
+/******************************************************************************/
+/* This library (module_cache) is maintained by Pan/SpinningKids, 2022-2024   */
+/******************************************************************************/
+
+#include <module_cache/module_cache.h>
+
+#include "cache_layout.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace module_cache;
+
+namespace
+{
+    // a shared memory object mapped read only, unmapped with the last buffer pointing into it
+    class Mapping final
+    {
+        void* base_;
+        size_t size_;
+
+    public:
+        Mapping(void* base, size_t size) noexcept : base_{base}, size_{size} {}
+        Mapping(const Mapping&) = delete;
+        Mapping& operator =(const Mapping&) = delete;
+        ~Mapping() { munmap(base_, size_); }
+
+        [[nodiscard]] const uint8_t* base() const noexcept { return static_cast<const uint8_t*>(base_); }
+    };
+
+    // Shares the mapping's ownership. The mixer takes frames as non const, but never writes them: the mapping
+    // being read only makes sure of it.
+    template <typename T>
+    std::shared_ptr<T[]> alias(const std::shared_ptr<Mapping>& mapping, uint64_t offset)
+    {
+        return {mapping, reinterpret_cast<T*>(const_cast<uint8_t*>(mapping->base()) + offset)};
+    }
+
+    bool request(const std::string& socket_path, const CacheRequest& request, CacheReply& reply)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        const bool answered = !connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) &&
+            sendAll(fd, &request, sizeof(request)) && receiveAll(fd, &reply, sizeof(reply));
+        close(fd);
+        return answered && reply.loaded;
+    }
+
+    std::shared_ptr<Mapping> map(const CacheReply& reply)
+    {
+        char shm_name[sizeof(reply.shm_name)];
+        memcpy(shm_name, reply.shm_name, sizeof(shm_name));
+        shm_name[sizeof(shm_name) - 1] = '\0';
+
+        const int fd = shm_open(shm_name, O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return {};
+        }
+        struct stat status{};
+        void* base = MAP_FAILED;
+        if (!fstat(fd, &status) && static_cast<uint64_t>(status.st_size) == reply.size &&
+            reply.size >= sizeof(CachedModule))
+        {
+            base = mmap(nullptr, reply.size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            return {};
+        }
+        auto mapping = std::make_shared<Mapping>(base, reply.size);
+        const auto& cached = *reinterpret_cast<const CachedModule*>(mapping->base());
+        if (memcmp(cached.magic, layout_magic, sizeof(layout_magic)) || cached.version != layout_version ||
+            cached.layout_size != sizeof(CachedModule) || cached.size != reply.size)
+        {
+            return {};
+        }
+        return mapping;
+    }
+}
+
+std::unique_ptr<Module> ModuleCacheClient::load(const char* name, const ModuleLoadOptions& options) const
+{
+    CacheRequest request{};
+    request.version = protocol_version;
+    request.mip_maps = options.mip_maps;
+    request.adpcm = options.adpcm;
+    // the daemon's working directory isn't ours
+    char path[PATH_MAX];
+    const char* absolute = realpath(name, path) ? path : name;
+    if (strlen(absolute) >= sizeof(request.name))
+    {
+        return {};
+    }
+    strcpy(request.name, absolute);
+
+    CacheReply reply{};
+    if (!::request(socket_path_, request, reply))
+    {
+        return {};
+    }
+    const std::shared_ptr<Mapping> mapping = map(reply);
+    if (!mapping)
+    {
+        return {};
+    }
+
+    const auto& cached = *reinterpret_cast<const CachedModule*>(mapping->base());
+    std::unique_ptr<Module> module{new (options.memory) Module};
+    module->header_ = cached.header;
+    if (cached.patterns)
+    {
+        module->pattern_ = alias<Pattern>(mapping, cached.patterns);
+    }
+    for (int i = 0; i < std::min<int>(cached.header.instruments_count, 128); ++i)
+    {
+        const CachedInstrument& cached_instrument = cached.instrument[i];
+        Instrument& instrument = module->instrument_[i];
+        instrument.header = cached_instrument.header;
+        instrument.instrument_sample_header = cached_instrument.instrument_sample_header;
+#ifdef FMUSIC_XM_VOLUMEENVELOPE_ACTIVE
+        instrument.volume_envelope = cached_instrument.volume_envelope;
+#endif
+#ifdef FMUSIC_XM_PANENVELOPE_ACTIVE
+        instrument.pan_envelope = cached_instrument.pan_envelope;
+#endif
+        instrument.reset();
+        for (int s = 0; s < std::min<int>(instrument.header.samples_count, 16); ++s)
+        {
+            const CachedSample& cached_sample = cached_instrument.sample[s];
+            Sample& sample = instrument.sample[s];
+            sample.header = cached_sample.header;
+            sample.storage = cached_sample.storage;
+            sample.mix_looped = cached_sample.mix_looped;
+            sample.mix_loop_start = cached_sample.mix_loop_start;
+            sample.mix_loop_length = cached_sample.mix_loop_length;
+            if (cached_sample.frames)
+            {
+                switch (sample.storage)
+                {
+                case SampleStorage::PCM16:
+                    sample.buff = alias<int16_t>(mapping, cached_sample.frames);
+                    break;
+                case SampleStorage::PCM8:
+                    sample.buff8 = alias<int8_t>(mapping, cached_sample.frames);
+                    break;
+                case SampleStorage::ADPCM:
+                    sample.adpcm = alias<uint8_t>(mapping, cached_sample.frames);
+                    break;
+                }
+            }
+            for (uint32_t level = 0; level < Sample::max_mip_levels && cached_sample.mip_frames[level]; ++level)
+            {
+                sample.mip_buff[level] = alias<int16_t>(mapping, cached_sample.mip_frames[level]);
+            }
+        }
+    }
+    return module;
+}
@@ -0,0 +1,315 @@
+/******************************************************************************/
+/* This library (module_cache) is maintained by Pan/SpinningKids, 2022-2024   */
+/******************************************************************************/
+
+#include <module_cache/module_cache.h>
+
+#include "cache_layout.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <chrono>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace module_cache;
+
+namespace
+{
+    // lays out module in a CachedModule, recording where its patterns and frames go: the object's size
+    uint64_t layOut(const Module& module, CachedModule& cached)
+    {
+        uint64_t size = aligned(sizeof(CachedModule));
+        const size_t patterns = std::min<size_t>(module.header_.patterns_count, 256);
+        cached.patterns = patterns ? size : 0;
+        size = aligned(size + patterns * sizeof(Pattern));
+
+        for (int i = 0; i < std::min<int>(module.header_.instruments_count, 128); ++i)
+        {
+            const Instrument& instrument = module.instrument_[i];
+            CachedInstrument& cached_instrument = cached.instrument[i];
+            cached_instrument.header = instrument.header;
+            cached_instrument.instrument_sample_header = instrument.instrument_sample_header;
+#ifdef FMUSIC_XM_VOLUMEENVELOPE_ACTIVE
+            cached_instrument.volume_envelope = instrument.volume_envelope;
+#endif
+#ifdef FMUSIC_XM_PANENVELOPE_ACTIVE
+            cached_instrument.pan_envelope = instrument.pan_envelope;
+#endif
+            for (int s = 0; s < std::min<int>(instrument.header.samples_count, 16); ++s)
+            {
+                const Sample& sample = instrument.sample[s];
+                CachedSample& cached_sample = cached_instrument.sample[s];
+                cached_sample.header = sample.header;
+                cached_sample.storage = sample.storage;
+                cached_sample.mix_looped = sample.mix_looped;
+                cached_sample.mix_loop_start = sample.mix_loop_start;
+                cached_sample.mix_loop_length = sample.mix_loop_length;
+                if (sample.buff || sample.buff8 || sample.adpcm)
+                {
+                    cached_sample.frames = size;
+                    size = aligned(size + sample.storedBytes());
+                }
+                for (uint32_t level = 0; level < Sample::max_mip_levels && sample.mip_buff[level]; ++level)
+                {
+                    cached_sample.mip_frames[level] = size;
+                    size = aligned(size + Sample::mipFrames(sample.storedFrames(), level) * sizeof(int16_t));
+                }
+            }
+        }
+        return size;
+    }
+
+    // receiveAll(), by a deadline: a client trickling its request a byte at a time can't keep the server either
+    bool receiveBy(int fd, void* data, size_t size, std::chrono::steady_clock::time_point deadline) noexcept
+    {
+        auto* p = static_cast<uint8_t*>(data);
+        while (size)
+        {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            pollfd ready{fd, POLLIN, 0};
+            if (left <= 0 || poll(&ready, 1, static_cast<int>(left)) <= 0)
+            {
+                return false;
+            }
+            const ssize_t count = recv(fd, p, size, MSG_DONTWAIT);
+            if (count <= 0)
+            {
+                return false;
+            }
+            p += count;
+            size -= static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    // copies module's patterns and frames where layOut() put them
+    void copyOut(const Module& module, const CachedModule& cached, uint8_t* base)
+    {
+        if (cached.patterns)
+        {
+            const size_t patterns = std::min<size_t>(module.header_.patterns_count, 256);
+            std::copy_n(module.pattern_.get(), patterns, reinterpret_cast<Pattern*>(base + cached.patterns));
+        }
+        for (int i = 0; i < std::min<int>(module.header_.instruments_count, 128); ++i)
+        {
+            const Instrument& instrument = module.instrument_[i];
+            for (int s = 0; s < std::min<int>(instrument.header.samples_count, 16); ++s)
+            {
+                const Sample& sample = instrument.sample[s];
+                const CachedSample& cached_sample = cached.instrument[i].sample[s];
+                if (cached_sample.frames)
+                {
+                    memcpy(base + cached_sample.frames, sample.frameData(), sample.storedBytes());
+                }
+                for (uint32_t level = 0; level < Sample::max_mip_levels && cached_sample.mip_frames[level]; ++level)
+                {
+                    memcpy(base + cached_sample.mip_frames[level], sample.mip_buff[level].get(),
+                           Sample::mipFrames(sample.storedFrames(), level) * sizeof(int16_t));
+                }
+            }
+        }
+    }
+}
+
+ModuleCacheServer::ModuleCacheServer(const char* socket_path, const minifmod::FileAccess& fileAccess) :
+    socket_path_{socket_path},
+    file_access_{fileAccess}
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path))
+    {
+        return;
+    }
+    memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener_ < 0)
+    {
+        return;
+    }
+    unlink(socket_path_.c_str()); // left by a daemon that didn't exit cleanly
+    if (bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) ||
+        listen(listener_, SOMAXCONN))
+    {
+        close(listener_);
+        listener_ = -1;
+    }
+}
+
+ModuleCacheServer::~ModuleCacheServer()
+{
+    for (const auto& [key, entry] : entries_)
+    {
+        shm_unlink(entry.shm_name.c_str());
+    }
+    if (listener_ >= 0)
+    {
+        close(listener_);
+        unlink(socket_path_.c_str());
+    }
+}
+
+void ModuleCacheServer::run()
+{
+    while (listening() && !stopping_.load(std::memory_order_relaxed))
+    {
+        const int client = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            break;
+        }
+        {
+            const std::lock_guard lock{mutex_};
+            ++workers_;
+        }
+        std::thread{[this, client]
+        {
+            serve(client);
+            close(client);
+            const std::lock_guard lock{mutex_};
+            --workers_;
+            changed_.notify_all();
+        }}.detach();
+    }
+    std::unique_lock lock{mutex_};
+    changed_.wait(lock, [this] { return workers_ == 0; });
+}
+
+void ModuleCacheServer::stop() noexcept
+{
+    stopping_.store(true, std::memory_order_relaxed);
+    if (listener_ >= 0)
+    {
+        shutdown(listener_, SHUT_RDWR); // wakes accept4()
+    }
+}
+
+void ModuleCacheServer::serve(int client)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{request_timeout_ms};
+    // and the reply, to a client that doesn't read it
+    const timeval send_timeout{request_timeout_ms / 1000, request_timeout_ms % 1000 * 1000};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    CacheRequest request;
+    if (!receiveBy(client, &request, sizeof(request), deadline) || request.version != protocol_version)
+    {
+        return;
+    }
+    request.name[sizeof(request.name) - 1] = '\0';
+
+    ModuleLoadOptions options;
+    options.mip_maps = request.mip_maps;
+    options.adpcm = request.adpcm;
+    std::string key = request.name;
+    key += options.mip_maps ? "|mip" : "|";
+    key += options.adpcm ? "|adpcm" : "|";
+
+    // names that aren't files (fileAccess may open anything) keep an empty stamp, and never change
+    FileStamp stamp;
+    struct stat file{};
+    if (!stat(request.name, &file))
+    {
+        stamp.modified_ns = static_cast<int64_t>(file.st_mtim.tv_sec) * 1000000000 + file.st_mtim.tv_nsec;
+        stamp.size = file.st_size;
+    }
+
+    CacheReply reply{};
+    std::unique_lock lock{mutex_};
+    changed_.wait(lock, [this, &key] { return !loading_.contains(key); });
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.stamp != stamp)
+    {
+        // loaded without the lock, so requests for other modules go on meanwhile
+        loading_.insert(key);
+        lock.unlock();
+        Entry entry;
+        entry.stamp = stamp;
+        const bool published = publish(request.name, options, entry);
+        lock.lock();
+        loading_.erase(key);
+        changed_.notify_all();
+
+        if (it != entries_.end())
+        {
+            // edited or gone since: clients that mapped the old copy keep it
+            shm_unlink(it->second.shm_name.c_str());
+            entries_.erase(it);
+        }
+        it = published ? entries_.emplace(std::move(key), std::move(entry)).first : entries_.end();
+    }
+    if (it != entries_.end())
+    {
+        reply.loaded = true;
+        snprintf(reply.shm_name, sizeof(reply.shm_name), "%s", it->second.shm_name.c_str());
+        reply.size = it->second.size;
+    }
+    lock.unlock();
+    sendAll(client, &reply, sizeof(reply));
+}
+
+bool ModuleCacheServer::publish(const char* name, const ModuleLoadOptions& options, Entry& entry)
+{
+    void* fp = file_access_.open(name);
+    if (!fp)
+    {
+        return false;
+    }
+    const auto module = std::make_unique<Module>(file_access_, fp, nullptr, options);
+    file_access_.close(fp);
+    if (memcmp(module->header_.header, "Extended Module: ", sizeof(module->header_.header)))
+    {
+        return false;
+    }
+
+    const auto cached = std::make_unique<CachedModule>();
+    memcpy(cached->magic, layout_magic, sizeof(layout_magic));
+    cached->version = layout_version;
+    cached->layout_size = sizeof(CachedModule);
+    cached->header = module->header_;
+    cached->size = layOut(*module, *cached);
+
+    char shm_name[64];
+    snprintf(shm_name, sizeof(shm_name), "/minixm-cache-%d-%u", static_cast<int>(getpid()), published_.fetch_add(1));
+    // read only for everybody once created, clients can't open it for writing
+    const int fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0444);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* base = MAP_FAILED;
+    if (!ftruncate(fd, static_cast<off_t>(cached->size)))
+    {
+        base = mmap(nullptr, cached->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        shm_unlink(shm_name);
+        return false;
+    }
+    memcpy(base, cached.get(), sizeof(CachedModule));
+    copyOut(*module, *cached, static_cast<uint8_t*>(base));
+    munmap(base, cached->size);
+
+    entry.shm_name = shm_name;
+    entry.size = cached->size;
+    return true;
+}
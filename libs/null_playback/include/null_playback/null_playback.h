@@ -0,0 +1,53 @@
+/******************************************************************************/
+//             null_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <minixm/playback.h>
+
+// Discards everything it mixes, for headless machines and benchmarks.
+//  - FreeRunning calls the fill function back to back and measures the mixing throughput.
+//  - Paced follows a simulated clock, refilling blocks as a real device would play them.
+class NullPlayback final : public IPlaybackDriver {
+public:
+    enum class Mode {
+        FreeRunning,
+        Paced,
+    };
+
+    NullPlayback(unsigned int mix_rate, Mode mode = Mode::FreeRunning, unsigned int buffer_size_ms = 1000,
+                 unsigned int latency = 20, std::pmr::memory_resource* memory = nullptr);
+    ~NullPlayback() override;
+
+    void start(FillFunction* fill, void* arg) override;
+    void stop() override;
+    uint64_t frames_played() const override;
+
+    // frames the fill function produced, blocks skipped on underruns left out
+    [[nodiscard]] uint64_t frames_mixed() const noexcept { return blocks_filled_ * block_size(); }
+    // mixing throughput since start(), in frames per second of wall-clock time
+    [[nodiscard]] double frames_per_second() const noexcept;
+    // blocks the simulated device reached before they were mixed, and skipped (Paced only)
+    [[nodiscard]] uint64_t underruns() const noexcept override { return underruns_; }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    void run(FillFunction* fill, void* arg);
+    [[nodiscard]] uint64_t blocks_played() const noexcept;
+
+    Mode mode_;
+    ResourceArray<short> buffer_;
+    clock::time_point start_time_;
+
+    std::atomic<uint64_t> blocks_filled_;
+    std::atomic<uint64_t> underruns_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
@@ -0,0 +1,103 @@
+/******************************************************************************/
+//             null_playback by Pan/SpinningKids, 2025
+/******************************************************************************/
+
+#include <null_playback/null_playback.h>
+
+#include <algorithm>
+
+NullPlayback::NullPlayback(unsigned int mix_rate, Mode mode, unsigned int buffer_size_ms, unsigned int latency,
+                           std::pmr::memory_resource* memory)
+    : IPlaybackDriver(mix_rate, buffer_size_ms, latency, memory),
+      mode_(mode),
+      buffer_(makeResourceArray<short>(memory_resource(), buffer_size() * 2)),
+      blocks_filled_(0),
+      underruns_(0),
+      running_(false)
+{
+}
+
+NullPlayback::~NullPlayback()
+{
+    stop();
+}
+
+void NullPlayback::start(FillFunction* fill, void* arg)
+{
+    if (thread_.joinable()) {
+        return;
+    }
+
+    blocks_filled_ = 0;
+    underruns_ = 0;
+    start_time_ = clock::now();
+    running_ = true;
+    thread_ = std::thread([this, fill, arg] { run(fill, arg); });
+}
+
+void NullPlayback::stop()
+{
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+}
+
+void NullPlayback::run(FillFunction* fill, void* arg)
+{
+    // blocks mixed and skipped, in the simulated device's order
+    const auto position = [this] { return blocks_filled_ + underruns_; };
+    const auto fill_next = [&] {
+        const size_t block = position() % blocks();
+        fill(arg, block, buffer_.get() + block * block_size() * 2, block_size());
+        ++blocks_filled_;
+    };
+
+    if (mode_ == Mode::FreeRunning) {
+        while (running_) {
+            fill_next();
+        }
+        return;
+    }
+
+    // prefill the whole "device" buffer, then keep everything but the playing block full
+    for (uint32_t i = 0; i < blocks(); ++i) {
+        fill_next();
+    }
+    const auto block_duration = std::chrono::duration<double>(static_cast<double>(block_size()) / mix_rate());
+    while (running_) {
+        const uint64_t played = blocks_played();
+        if (played + 1 > position()) {
+            // the simulated device caught up with us: skip ahead, as a real one would play garbage
+            underruns_ += played + 1 - position();
+        }
+        while (position() < played + blocks()) {
+            fill_next();
+        }
+        std::this_thread::sleep_until(start_time_ + std::chrono::duration_cast<clock::duration>(
+            block_duration * static_cast<double>(played + 1)));
+    }
+}
+
+uint64_t NullPlayback::blocks_played() const noexcept
+{
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start_time_).count();
+    return static_cast<uint64_t>(elapsed) * mix_rate() / 1000000ull / block_size();
+}
+
+uint64_t NullPlayback::frames_played() const
+{
+    if (mode_ == Mode::FreeRunning) {
+        // nothing is ever played, the last mixed frame is the best we have
+        return frames_mixed();
+    }
+    // the skipped blocks played nothing that was mixed
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start_time_).count();
+    const uint64_t device_frames = static_cast<uint64_t>(elapsed) * mix_rate() / 1000000ull;
+    const uint64_t skipped_frames = underruns_ * block_size();
+    return std::min<uint64_t>(device_frames > skipped_frames ? device_frames - skipped_frames : 0, frames_mixed());
+}
+
+double NullPlayback::frames_per_second() const noexcept
+{
+    const double elapsed = std::chrono::duration<double>(clock::now() - start_time_).count();
+    return elapsed > 0 ? static_cast<double>(frames_mixed()) / elapsed : 0.0;
+}
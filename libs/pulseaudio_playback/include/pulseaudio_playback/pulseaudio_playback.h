@@ -4,24 +4,31 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
-#include <memory>
 #include <thread>
 #include <atomic>
 #include <minixm/playback.h>
+#include <minixm/seqlock.h>
 #include <pulse/pulseaudio.h>
 
 class PulseAudioPlayback : public IPlaybackDriver {
 public:
-    PulseAudioPlayback(unsigned int mix_rate, unsigned int buffer_size_ms = 1000, unsigned int latency = 20);
+    PulseAudioPlayback(unsigned int mix_rate, unsigned int buffer_size_ms = 1000, unsigned int latency = 20,
+                       std::pmr::memory_resource* memory = nullptr);
     ~PulseAudioPlayback();
 
     void start(FillFunction* fill, void* arg) override;
     void stop() override;
-    size_t current_block_played() const override;
+    uint64_t frames_played() const override;
+    uint64_t underruns() const override;
 
 private:
     static void pa_write_cb(pa_stream* s, size_t nbytes, void* userdata);
+    static void pa_underflow_cb(pa_stream* s, void* userdata);
+    static void pa_started_cb(pa_stream* s, void* userdata);
+    static void pa_latency_cb(pa_stream* s, void* userdata);
+    void updatePosition(bool running);
 
     pa_mainloop* loop_;
     pa_mainloop_api* api_;
@@ -30,8 +37,21 @@ private:
 
     FillFunction* fill_func_;
     void* fill_arg_;
-    std::unique_ptr<int16_t[]> buffer_;
-    size_t current_block_;
+    std::atomic<uint64_t> frames_written_; // ring position of the next frame handed to the server
+    std::atomic<uint64_t> underruns_{0};
+
+    using clock = std::chrono::steady_clock;
+
+    // the stream's clock as the mainloop thread last read it, extrapolated by the readers until the next update:
+    // the stream belongs to the mainloop, other threads can't ask it
+    struct PlayedSnapshot {
+        uint64_t frames;
+        uint64_t frames_written;
+        clock::rep time;
+        bool running;
+    };
+
+    SeqLock<PlayedSnapshot> played_;
 
     std::thread mainloop_thread_;
     std::atomic<bool> running_;
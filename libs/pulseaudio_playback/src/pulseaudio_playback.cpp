@@ -5,14 +5,17 @@
 #include <pulseaudio_playback/pulseaudio_playback.h>
 #include <pulse/pulseaudio.h>
 
-PulseAudioPlayback::PulseAudioPlayback(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency)
-    : IPlaybackDriver(mix_rate, buffer_size_ms, latency),
+#include <algorithm>
+
+PulseAudioPlayback::PulseAudioPlayback(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency,
+                                       std::pmr::memory_resource* memory)
+    : IPlaybackDriver(mix_rate, buffer_size_ms, latency, memory),
       loop_(nullptr),
       context_(nullptr),
       stream_(nullptr),
       fill_func_(nullptr),
       fill_arg_(nullptr),
-      current_block_(0),
+      frames_written_(0),
       running_(true)
 {
     loop_ = pa_mainloop_new();
@@ -45,8 +48,10 @@ PulseAudioPlayback::PulseAudioPlayback(unsigned int mix_rate, unsigned int buffe
         pa_mainloop_iterate(loop_, 1, nullptr);
     }
 
+    // PulseAudio converts anything, and float is what the mixer makes
+    setSampleFormat(SampleFormat::F32);
     pa_sample_spec ss;
-    ss.format = PA_SAMPLE_S16LE;
+    ss.format = PA_SAMPLE_FLOAT32LE;
     ss.rate = mix_rate;
     ss.channels = 2;
 
@@ -60,14 +65,23 @@ PulseAudioPlayback::PulseAudioPlayback(unsigned int mix_rate, unsigned int buffe
         return;
     }
 
-    buffer_.reset(new int16_t[block_size() * 2]);
-
     pa_stream_set_write_callback(stream_, &PulseAudioPlayback::pa_write_cb, this);
+    pa_stream_set_underflow_callback(stream_, &PulseAudioPlayback::pa_underflow_cb, this);
+    pa_stream_set_started_callback(stream_, &PulseAudioPlayback::pa_started_cb, this);
+    pa_stream_set_latency_update_callback(stream_, &PulseAudioPlayback::pa_latency_cb, this);
 
     pa_stream_flags_t stream_flags;
     stream_flags = pa_stream_flags_t(PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_NOT_MONOTONIC |
                  PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_ADJUST_LATENCY);
-    pa_stream_connect_playback(stream_, nullptr, nullptr, stream_flags, nullptr, nullptr);
+
+    // ask for exactly our buffer as the target latency, and to be woken up once per block
+    pa_buffer_attr buffer_attr;
+    buffer_attr.maxlength = static_cast<uint32_t>(-1);
+    buffer_attr.tlength = static_cast<uint32_t>(pa_usec_to_bytes(pa_usec_t{buffer_size_ms} * 1000, &ss));
+    buffer_attr.prebuf = static_cast<uint32_t>(-1);
+    buffer_attr.minreq = static_cast<uint32_t>(pa_usec_to_bytes(pa_usec_t{latency} * 1000, &ss));
+    buffer_attr.fragsize = static_cast<uint32_t>(-1);
+    pa_stream_connect_playback(stream_, nullptr, &buffer_attr, stream_flags, nullptr, nullptr);
 
     // Wait for stream to be ready, with a timeout
     int max_wait = 100; // 100 * 10ms = 1 second
@@ -112,7 +126,9 @@ void PulseAudioPlayback::start(FillFunction* fill, void* arg)
 
     fill_func_ = fill;
     fill_arg_ = arg;
-    current_block_ = 0;
+    frames_written_ = 0;
+    underruns_ = 0;
+    played_.store({});
 
     if (!stream_) {
         return;
@@ -158,35 +174,91 @@ PulseAudioPlayback::~PulseAudioPlayback()
 void PulseAudioPlayback::pa_write_cb(pa_stream* s, size_t nbytes, void* userdata)
 {
     auto* self = static_cast<PulseAudioPlayback*>(userdata);
-    auto block_bytes = self->block_size() * 2 * sizeof(buffer_[0]); // stereo 16-bit
-
-    if (!self || !self->buffer_) {
+    if (!self || !self->fill_func_) {
         return;
     }
+    const size_t frame_bytes = self->frame_bytes();
 
-    while (nbytes >= block_bytes) {
-        nbytes -= block_bytes;
+    // mix straight into the server's memory, exactly as much as it asked for
+    while (nbytes >= frame_bytes) {
+        void* data = nullptr;
+        size_t bytes = nbytes;
+        if (pa_stream_begin_write(s, &data, &bytes) < 0 || !data) {
+            return;
+        }
+        const auto frames = static_cast<uint32_t>(bytes / frame_bytes);
+        if (!frames) {
+            pa_stream_cancel_write(s);
+            return;
+        }
 
-        // Fill the block
-        if (self->fill_func_) {
-            self->fill_func_(self->fill_arg_, self->current_block_, self->buffer_.get());
+        // the mixer takes at most a block at a time, keep the block numbers in step with the ring
+        auto* target = static_cast<char*>(data);
+        for (uint32_t done = 0; done < frames;) {
+            const auto in_block = static_cast<uint32_t>(self->frames_written_ % self->block_size());
+            const uint32_t count = std::min(frames - done, self->block_size() - in_block);
+            const auto block = static_cast<size_t>((self->frames_written_ / self->block_size()) % self->blocks());
+            self->fill_func_(self->fill_arg_, block, target + done * frame_bytes, count);
+            self->frames_written_ += count;
+            done += count;
         }
 
-        pa_stream_write(s,
-                        self->buffer_.get(),
-                        block_bytes,
-                        nullptr,
-                        0,
-                        PA_SEEK_RELATIVE);
-        self->current_block_ = (self->current_block_ + 1) % self->blocks();
+        bytes = frames * frame_bytes;
+        pa_stream_write(s, data, bytes, nullptr, 0, PA_SEEK_RELATIVE);
+        nbytes -= bytes;
     }
+    self->updatePosition(self->played_.load().running);
 }
 
-size_t PulseAudioPlayback::current_block_played() const
+// on the mainloop thread only
+void PulseAudioPlayback::updatePosition(bool running)
 {
+    // the stream interpolates its clock between timing updates (PA_STREAM_INTERPOLATE_TIMING)
     pa_usec_t usec = 0;
-    if (pa_stream_get_time(stream_, &usec) == 0) {
-        return static_cast<size_t>((usec * mix_rate() / block_size() / 1000000ull) % blocks());
+    if (stream_ && pa_stream_get_time(stream_, &usec) == 0) {
+        const uint64_t written = frames_written_;
+        played_.store({
+            std::min<uint64_t>(usec * mix_rate() / 1000000ull, written),
+            written,
+            clock::now().time_since_epoch().count(),
+            running,
+        });
     }
-    return 0;
+}
+
+uint64_t PulseAudioPlayback::frames_played() const
+{
+    const PlayedSnapshot played = played_.load();
+    if (!played.running) {
+        return played.frames;
+    }
+    // the server keeps going at mix_rate() between our updates, but can't play what we haven't written
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock::now() - clock::time_point{clock::duration{played.time}}).count();
+    const uint64_t advance = static_cast<uint64_t>(std::max<int64_t>(elapsed, 0)) * mix_rate() / 1000000ull;
+    return std::min(played.frames + advance, played.frames_written);
+}
+
+void PulseAudioPlayback::pa_underflow_cb(pa_stream*, void* userdata)
+{
+    // the server played everything it had and is waiting for more: the clock stops until it starts again
+    auto* self = static_cast<PulseAudioPlayback*>(userdata);
+    self->underruns_++;
+    self->updatePosition(false);
+}
+
+void PulseAudioPlayback::pa_started_cb(pa_stream*, void* userdata)
+{
+    static_cast<PulseAudioPlayback*>(userdata)->updatePosition(true);
+}
+
+void PulseAudioPlayback::pa_latency_cb(pa_stream*, void* userdata)
+{
+    auto* self = static_cast<PulseAudioPlayback*>(userdata);
+    self->updatePosition(self->played_.load().running);
+}
+
+uint64_t PulseAudioPlayback::underruns() const
+{
+    return underruns_;
 }
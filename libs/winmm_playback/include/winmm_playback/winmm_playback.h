@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <thread>
 
 #include <minixm/playback.h>
@@ -23,13 +24,16 @@
 
 class WindowsPlayback final : public IPlaybackDriver
 {
-    std::unique_ptr<short[]> buffer_;
+    ResourceArray<short> buffer_;
 
     HWAVEOUT wave_out_handle_ = nullptr;
 
     std::thread software_thread_;
     bool software_thread_exit_ = true; // mixing thread termination flag
 
+    // waveOutGetPosition wraps at 32 bits, this extends it (it's polled far more often than it wraps)
+    mutable std::atomic<uint64_t> frames_played_{0};
+
 public:
     WindowsPlayback() = delete;
     WindowsPlayback(const WindowsPlayback&) = delete;
@@ -37,7 +41,8 @@ public:
     WindowsPlayback& operator =(const WindowsPlayback&) = delete;
     WindowsPlayback& operator =(WindowsPlayback&&) = delete;
 
-    WindowsPlayback(unsigned int mix_rate, unsigned int buffer_size_ms = 1000, unsigned int latency = 20);
+    WindowsPlayback(unsigned int mix_rate, unsigned int buffer_size_ms = 1000, unsigned int latency = 20,
+                    std::pmr::memory_resource* memory = nullptr);
 
     void start(FillFunction* fill, void* arg) override;
 
@@ -45,5 +50,5 @@ public:
 
     ~WindowsPlayback() override;
 
-    [[nodiscard]] size_t current_block_played() const override;
+    [[nodiscard]] uint64_t frames_played() const override;
 };
@@ -12,9 +12,10 @@
 
 #include <winmm_playback/winmm_playback.h>
 
-WindowsPlayback::WindowsPlayback(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency) :
-    IPlaybackDriver(mix_rate, buffer_size_ms, latency),
-    buffer_{ std::make_unique_for_overwrite<short[]>(buffer_size() * 2) }
+WindowsPlayback::WindowsPlayback(unsigned int mix_rate, unsigned int buffer_size_ms, unsigned int latency,
+                                 std::pmr::memory_resource* memory) :
+    IPlaybackDriver(mix_rate, buffer_size_ms, latency, memory),
+    buffer_{ makeResourceArray<short>(memory_resource(), buffer_size() * 2) }
 {
 }
 
@@ -58,10 +59,12 @@ void WindowsPlayback::start(FillFunction* fill, void* arg)
                 };
                 waveOutPrepareHeader(wave_out_handle_, &wave_header, sizeof(WAVEHDR));
 
+                frames_played_ = 0;
+
                 // pre-fill
                 for (DWORD i = 0; i < blocks(); ++i)
                 {
-                    fill(arg, i, buffer_.get() + i * block_size() * 2);
+                    fill(arg, i, buffer_.get() + i * block_size() * 2, block_size());
                 }
 
                 // ========================================================================================================
@@ -74,9 +77,11 @@ void WindowsPlayback::start(FillFunction* fill, void* arg)
 
                 while (!software_thread_exit_)
                 {
-                    while (software_fill_block != current_block_played())
+                    const auto block_played = static_cast<DWORD>((frames_played() / block_size()) % blocks());
+                    while (software_fill_block != block_played)
                     {
-                        fill(arg, software_fill_block, buffer_.get() + software_fill_block * block_size() * 2);
+                        fill(arg, software_fill_block, buffer_.get() + software_fill_block * block_size() * 2,
+                             block_size());
                         software_fill_block = (software_fill_block + 1) % blocks();
                     }
 
@@ -112,11 +117,30 @@ WindowsPlayback::~WindowsPlayback()
     stop();
 }
 
-[[nodiscard]] size_t WindowsPlayback::current_block_played() const
+[[nodiscard]] uint64_t WindowsPlayback::frames_played() const
 {
     MMTIME mmt{
         .wType = TIME_SAMPLES
     };
-    waveOutGetPosition(wave_out_handle_, &mmt, sizeof(MMTIME));
-    return (static_cast<size_t>(mmt.u.cb) / block_size()) % blocks();
+    if (!wave_out_handle_ || waveOutGetPosition(wave_out_handle_, &mmt, sizeof(MMTIME)))
+    {
+        return frames_played_;
+    }
+
+    uint64_t previous = frames_played_;
+    uint64_t current;
+    do
+    {
+        current = (previous & ~0xFFFFFFFFull) | mmt.u.sample;
+        if (current + 0x80000000ull < previous)
+        {
+            current += 0x100000000ull; // wrapped
+        }
+        else if (current <= previous)
+        {
+            return previous; // another thread got a newer position in the meantime
+        }
+    }
+    while (!frames_played_.compare_exchange_weak(previous, current));
+    return current;
 }
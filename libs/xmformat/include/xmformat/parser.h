@@ -0,0 +1,364 @@
+/******************************************************************************/
+/* This library (xmformat) is maintained by Pan/SpinningKids, 2022-2024       */
+/******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <vector>
+
+#include "file_header.h"
+#include "instrument_header.h"
+#include "instrument_sample_header.h"
+#include "pattern_cell.h"
+#include "pattern_header.h"
+#include "sample_header.h"
+
+// the parts of the file XMParser hands over, besides the headers
+enum XMParseFlags : uint8_t
+{
+    XMParseHeaders = 0,
+    XMParsePatternData = 1,
+    XMParseSampleData = 2,
+    XMParseAll = XMParsePatternData | XMParseSampleData
+};
+
+// What XMParser finds, in file order. Returning false stops the parser.
+class XMParserHandler
+{
+public:
+    virtual ~XMParserHandler() = default;
+
+    virtual bool onHeader(const XMHeader& header) = 0;
+    // rows * channels_count cells, unpacked, row after row (all empty if the pattern has no data), null when
+    // pattern data isn't parsed
+    virtual bool onPattern(int index, const XMPatternHeader& header, const XMPatternCell* cells) = 0;
+    // sample_header is null if the instrument has no samples
+    virtual bool onInstrument(int index, const XMInstrumentHeader& header,
+                              const XMInstrumentSampleHeader* sample_header) = 0;
+    // headers as stored, lengths in bytes
+    virtual bool onSampleHeader(int instrument, int sample, const XMSampleHeader& header) = 0;
+    // the stored (delta coded) bytes of a sample as they come, offset bytes into it
+    virtual bool onSampleData(int instrument, int sample, uint32_t offset, const uint8_t* data, size_t size) = 0;
+};
+
+// Incremental XM parser: takes the file in chunks of any size and never seeks, skipping what header sizes say
+// to skip as it goes, so modules can be read from pipes and downloads as they arrive. Sample data is handed
+// over without being buffered, or skipped along with pattern data: a seekable source can then seek past what
+// skippable() says and only read headers. Its buffers (a pattern at a time) come from the memory resource given.
+class XMParser final
+{
+    enum class State : uint8_t
+    {
+        Header,
+        PatternHeader,
+        PatternData,
+        InstrumentHeader,
+        InstrumentSampleHeader,
+        SampleHeaders,
+        SampleData,
+        Done,
+        Stopped,
+    };
+
+    static constexpr size_t header_size_end = 64; // the header up to its own header_size
+
+    XMParserHandler& handler_;
+    XMParseFlags parts_;
+    State state_ = State::Header;
+    std::pmr::vector<uint8_t> staging_; // the structure being collected
+    size_t need_ = header_size_end; // its size
+    uint64_t skip_ = 0; // bytes to drop before the next one
+    uint64_t offset_ = 0;
+
+    XMHeader header_{};
+    int pattern_ = 0;
+    XMPatternHeader pattern_header_{};
+    std::pmr::vector<XMPatternCell> cells_;
+    int instrument_ = 0;
+    XMInstrumentHeader instrument_header_{};
+    std::pmr::vector<XMSampleHeader> sample_headers_;
+    int sample_ = 0;
+    uint32_t sample_offset_ = 0;
+
+    template <typename T>
+    [[nodiscard]] T staged() const noexcept
+    {
+        T value{};
+        memcpy(&value, staging_.data(), std::min(sizeof(T), staging_.size()));
+        return value;
+    }
+
+    void collect(State state, size_t bytes)
+    {
+        state_ = state;
+        need_ = bytes;
+        staging_.clear();
+    }
+
+    void nextPattern()
+    {
+        if (pattern_ < header_.patterns_count)
+        {
+            collect(State::PatternHeader, sizeof(XMPatternHeader));
+        }
+        else
+        {
+            nextInstrument();
+        }
+    }
+
+    void nextInstrument()
+    {
+        if (instrument_ < header_.instruments_count)
+        {
+            collect(State::InstrumentHeader, sizeof(XMInstrumentHeader));
+        }
+        else
+        {
+            state_ = State::Done;
+        }
+    }
+
+    void nextSample()
+    {
+        while (sample_ < static_cast<int>(sample_headers_.size()) && !sample_headers_[sample_].length)
+        {
+            ++sample_;
+        }
+        if (sample_ < static_cast<int>(sample_headers_.size()))
+        {
+            state_ = State::SampleData;
+            sample_offset_ = 0;
+        }
+        else
+        {
+            ++instrument_;
+            nextInstrument();
+        }
+    }
+
+    // same packing as FastTracker 2 writes: a byte with the top bit set says which fields follow
+    void unpackPattern()
+    {
+        const size_t channels = header_.channels_count;
+        cells_.assign(pattern_header_.rows * channels, XMPatternCell{});
+        size_t in = 0;
+        for (XMPatternCell& cell : cells_)
+        {
+            if (in >= staging_.size())
+            {
+                break;
+            }
+            auto next = [this, &in] { return in < staging_.size() ? staging_[in++] : uint8_t{0}; };
+            const uint8_t dat = next();
+            auto* fields = reinterpret_cast<uint8_t*>(&cell);
+            if (dat & 0x80)
+            {
+                for (int field = 0; field < 5; ++field)
+                {
+                    if (dat & (1 << field))
+                    {
+                        fields[field] = next();
+                    }
+                }
+            }
+            else
+            {
+                fields[0] = dat;
+                for (int field = 1; field < 5; ++field)
+                {
+                    fields[field] = next();
+                }
+            }
+        }
+    }
+
+    // the structure being collected is complete
+    bool complete()
+    {
+        switch (state_)
+        {
+        case State::Header:
+            {
+                const uint64_t total = 60 + static_cast<uint64_t>(staged<XMHeader>().header_size);
+                const size_t stored = static_cast<size_t>(std::min<uint64_t>(sizeof(XMHeader), total));
+                if (staging_.size() < stored)
+                {
+                    need_ = stored; // and the rest of it
+                    return true;
+                }
+                header_ = staged<XMHeader>();
+                skip_ = total > staging_.size() ? total - staging_.size() : 0;
+                if (!handler_.onHeader(header_))
+                {
+                    return false;
+                }
+                nextPattern();
+                return true;
+            }
+        case State::PatternHeader:
+            pattern_header_ = staged<XMPatternHeader>();
+            skip_ = pattern_header_.header_size > sizeof(XMPatternHeader) ?
+                        pattern_header_.header_size - sizeof(XMPatternHeader) : 0;
+            if (!(parts_ & XMParsePatternData))
+            {
+                skip_ += pattern_header_.packed_pattern_data_size;
+                if (!handler_.onPattern(pattern_++, pattern_header_, nullptr))
+                {
+                    return false;
+                }
+                nextPattern();
+                return true;
+            }
+            collect(State::PatternData, pattern_header_.packed_pattern_data_size);
+            return true;
+        case State::PatternData:
+            unpackPattern();
+            if (!handler_.onPattern(pattern_++, pattern_header_, cells_.data()))
+            {
+                return false;
+            }
+            nextPattern();
+            return true;
+        case State::InstrumentHeader:
+            instrument_header_ = staged<XMInstrumentHeader>();
+            if (instrument_header_.samples_count)
+            {
+                collect(State::InstrumentSampleHeader, sizeof(XMInstrumentSampleHeader));
+                return true;
+            }
+            skip_ = instrument_header_.header_size > sizeof(XMInstrumentHeader) ?
+                        instrument_header_.header_size - sizeof(XMInstrumentHeader) : 0;
+            if (!handler_.onInstrument(instrument_++, instrument_header_, nullptr))
+            {
+                return false;
+            }
+            nextInstrument();
+            return true;
+        case State::InstrumentSampleHeader:
+            {
+                constexpr size_t read = sizeof(XMInstrumentHeader) + sizeof(XMInstrumentSampleHeader);
+                const auto sample_header = staged<XMInstrumentSampleHeader>();
+                skip_ = instrument_header_.header_size > read ? instrument_header_.header_size - read : 0;
+                if (!handler_.onInstrument(instrument_, instrument_header_, &sample_header))
+                {
+                    return false;
+                }
+                collect(State::SampleHeaders, instrument_header_.samples_count * sizeof(XMSampleHeader));
+                return true;
+            }
+        case State::SampleHeaders:
+            sample_headers_.resize(instrument_header_.samples_count);
+            for (size_t i = 0; i < sample_headers_.size(); ++i)
+            {
+                memcpy(&sample_headers_[i], staging_.data() + i * sizeof(XMSampleHeader), sizeof(XMSampleHeader));
+                if (!handler_.onSampleHeader(instrument_, static_cast<int>(i), sample_headers_[i]))
+                {
+                    return false;
+                }
+            }
+            if (!(parts_ & XMParseSampleData))
+            {
+                for (const XMSampleHeader& header : sample_headers_)
+                {
+                    skip_ += header.length;
+                }
+                sample_headers_.clear();
+            }
+            sample_ = 0;
+            nextSample();
+            return true;
+        default:
+            return false;
+        }
+    }
+
+public:
+    explicit XMParser(XMParserHandler& handler, XMParseFlags parts = XMParseAll,
+                      std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+        handler_{handler},
+        parts_{parts},
+        staging_{memory},
+        cells_{memory},
+        sample_headers_{memory}
+    {
+    }
+
+    // Parses the next size bytes of the file. False once the handler stopped it; bytes past the end are ignored.
+    bool feed(const void* data, size_t size)
+    {
+        const auto* in = static_cast<const uint8_t*>(data);
+        while (state_ != State::Done && state_ != State::Stopped)
+        {
+            if (skip_)
+            {
+                const size_t count = static_cast<size_t>(std::min<uint64_t>(skip_, size));
+                skip_ -= count;
+                in += count;
+                size -= count;
+                offset_ += count;
+                if (skip_)
+                {
+                    break;
+                }
+            }
+            else if (state_ == State::SampleData)
+            {
+                const uint32_t length = sample_headers_[sample_].length;
+                const size_t count = std::min<size_t>(length - sample_offset_, size);
+                if (count && !handler_.onSampleData(instrument_, sample_, sample_offset_, in, count))
+                {
+                    state_ = State::Stopped;
+                    break;
+                }
+                sample_offset_ += static_cast<uint32_t>(count);
+                in += count;
+                size -= count;
+                offset_ += count;
+                if (sample_offset_ < length)
+                {
+                    break;
+                }
+                ++sample_;
+                nextSample();
+            }
+            else
+            {
+                const size_t count = std::min(need_ - staging_.size(), size);
+                staging_.insert(staging_.end(), in, in + count);
+                in += count;
+                size -= count;
+                offset_ += count;
+                if (staging_.size() < need_)
+                {
+                    break;
+                }
+                if (!complete())
+                {
+                    state_ = State::Stopped;
+                }
+            }
+        }
+        return state_ != State::Stopped;
+    }
+
+    // bytes the parser will drop before it needs more: a seekable source can seek past them and call skip()
+    [[nodiscard]] uint64_t skippable() const noexcept { return skip_; }
+
+    void skip(uint64_t bytes) noexcept
+    {
+        bytes = std::min(bytes, skip_);
+        skip_ -= bytes;
+        offset_ += bytes;
+    }
+
+    // all patterns, instruments and samples were handed over
+    [[nodiscard]] bool done() const noexcept { return state_ == State::Done; }
+
+    // bytes of the file parsed so far: during onSampleData, where its data starts
+    [[nodiscard]] uint64_t offset() const noexcept { return offset_; }
+};